@@ -0,0 +1,252 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+// Renders synthetic scenes of many small meshes with several pipelines on a
+// headless EGL context, and prints the throughput as JSON.
+//
+// Usage: moggle_bench_draw [--meshes N] [--pipelines M] [--frames F] [--mode mesh|batch|both]
+//
+// Runs without a GPU or display on Mesa (e.g. with LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe).
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <moggle/core/draw_batch.hpp>
+#include <moggle/core/framebuffer.hpp>
+#include <moggle/core/gl.hpp>
+#include <moggle/core/gl_state.hpp>
+#include <moggle/core/profiler.hpp>
+#include <moggle/xxx/mesh.hpp>
+#include <moggle/xxx/shader_pipeline.hpp>
+
+using namespace moggle;
+
+namespace {
+
+struct options {
+	std::size_t meshes = 10000;
+	std::size_t pipelines = 4;
+	std::size_t frames = 100;
+	std::string mode = "both";
+};
+
+// Creates a surfaceless core profile context, of the highest version that is supported.
+void make_context() {
+	auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (!get_platform_display) throw std::runtime_error("EGL_EXT_platform_base is not supported.");
+	EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (!eglInitialize(display, nullptr, nullptr)) throw std::runtime_error("Unable to initialize EGL.");
+	eglBindAPI(EGL_OPENGL_API);
+	EGLContext context = EGL_NO_CONTEXT;
+	for (EGLint version : {45, 43, 33}) {
+		EGLint attributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, version / 10,
+			EGL_CONTEXT_MINOR_VERSION, version % 10,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+		if (context != EGL_NO_CONTEXT) break;
+	}
+	if (context == EGL_NO_CONTEXT) throw std::runtime_error("Unable to create an OpenGL context.");
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) throw std::runtime_error("Unable to make the context current.");
+}
+
+char const * const code = R"(
+operation place(in vec2 position, in vec2 offset, out vec4 p) { p = vec4(position + offset, 0, 1); }
+operation tint(in vec4 color, out vec4 c) { c = color; }
+)";
+
+struct result {
+	std::string mode;
+	std::size_t draws = 0;
+	double submit_seconds = 0;
+	double frame_seconds = 0;
+	unsigned long long gl_calls = 0;
+	std::size_t binds_issued = 0;
+	std::size_t binds_skipped = 0;
+};
+
+// Draws every frame, and measures the time to submit the draws, and the time until they're finished.
+template<typename Frame>
+result measure(std::string mode, options const & o, Frame && frame) {
+	frame(); // Warm up: first uploads, vertex array setup, shader compilation in the driver.
+	gl::finish();
+	result r;
+	r.mode = std::move(mode);
+	auto calls = gl::call_count();
+	gl::state().reset_stats();
+	for (std::size_t f = 0; f < o.frames; ++f) {
+		auto start = std::chrono::steady_clock::now();
+		r.draws += frame();
+		auto submitted = std::chrono::steady_clock::now();
+		gl::finish();
+		auto finished = std::chrono::steady_clock::now();
+		r.submit_seconds += std::chrono::duration<double>(submitted - start).count();
+		r.frame_seconds += std::chrono::duration<double>(finished - start).count();
+	}
+	r.gl_calls = gl::call_count() - calls;
+	r.binds_issued = gl::state().stats().issued;
+	r.binds_skipped = gl::state().stats().skipped;
+	return r;
+}
+
+void print(std::ostream & out, result const & r, options const & o) {
+	out << "    {\n";
+	out << "      \"mode\": \"" << r.mode << "\",\n";
+	out << "      \"draws_per_second\": " << r.draws / r.submit_seconds << ",\n";
+	out << "      \"gl_calls_per_draw\": " << double(r.gl_calls) / r.draws << ",\n";
+	out << "      \"submit_ms_per_frame\": " << r.submit_seconds * 1000 / o.frames << ",\n";
+	out << "      \"frame_ms_per_frame\": " << r.frame_seconds * 1000 / o.frames << ",\n";
+	out << "      \"binds_issued_per_frame\": " << double(r.binds_issued) / o.frames << ",\n";
+	out << "      \"binds_skipped_per_frame\": " << double(r.binds_skipped) / o.frames << "\n";
+	out << "    }";
+}
+
+}
+
+int main(int argc, char * * argv) {
+	options o;
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 == argc) {
+			std::cerr << "Missing value for option: " << argv[i] << std::endl;
+			return 1;
+		}
+		if (!std::strcmp(argv[i], "--meshes")) o.meshes = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (!std::strcmp(argv[i], "--pipelines")) o.pipelines = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (!std::strcmp(argv[i], "--frames")) o.frames = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (!std::strcmp(argv[i], "--mode")) o.mode = argv[i + 1];
+		else {
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+	if (!o.meshes || !o.pipelines || !o.frames) {
+		std::cerr << "The number of meshes, pipelines and frames must be positive." << std::endl;
+		return 1;
+	}
+
+	make_context();
+	#ifdef GLEW_VERSION
+	glewExperimental = GL_TRUE;
+	#endif
+	gl::init();
+
+	texture color;
+	color.storage(GL_RGBA8, 256, 256, 1);
+	framebuffer target;
+	target.attach(GL_COLOR_ATTACHMENT0, color);
+	target.check();
+	target.bind();
+	gl::viewport(0, 0, 256, 256);
+
+	pipeline_compiler compiler(330);
+	compiler.add_code(code);
+	std::vector<std::unique_ptr<pipeline>> pipelines;
+	for (std::size_t i = 0; i < o.pipelines; ++i) {
+		std::unique_ptr<pipeline> p{new pipeline};
+		float f = float(i + 1) / o.pipelines;
+		p->vertex_operations.push_back("place");
+		p->special_vertex_outputs[{"vec4", "gl_Position"}] = "p";
+		p->fragment_operations.push_back(shader_pipeline::operation{"tint", {{"color", vector4<float>{f, 1 - f, 0.5f, 1}}}});
+		p->special_fragment_outputs[{"vec4", "gl_FragColor"}] = "c";
+		compiler.compile(*p);
+		pipelines.push_back(std::move(p));
+	}
+
+	// Every mesh is a small quad somewhere on the screen.
+	auto offset_of = [] (std::size_t i) {
+		return vector2<float>{float(i % 100) / 50 - 1, float(i / 100 % 100) / 50 - 1};
+	};
+	std::vector<vector2<float>> const corners {{0, 0}, {0.02f, 0}, {0.02f, 0.02f}, {0, 0.02f}};
+
+	// Mode 'mesh': separate vertices and indices per mesh, drawn with mesh::draw().
+	std::vector<mesh> meshes;
+	for (std::size_t i = 0; i < o.meshes; ++i) {
+		vertices v;
+		v.attribute("position", buffer<vector2<float>>(corners));
+		v.attribute("offset", buffer<vector2<float>>(4, offset_of(i)));
+		meshes.emplace_back(std::move(v), buffer<GLushort>{0, 1, 2, 0, 2, 3});
+	}
+
+	// Mode 'batch': shared vertices and indices, drawn with one draw_batch per pipeline.
+	buffer<vector2<float>> positions;
+	buffer<vector2<float>> offsets;
+	for (std::size_t i = 0; i < o.meshes; ++i) {
+		positions.insert(positions.end(), corners.begin(), corners.end());
+		offsets.insert(offsets.end(), 4, offset_of(i));
+	}
+	positions.mark_dirty();
+	offsets.mark_dirty();
+	vertices shared;
+	shared.attribute("position", std::move(positions));
+	shared.attribute("offset", std::move(offsets));
+	mesh shared_mesh{std::move(shared), buffer<GLushort>{0, 1, 2, 0, 2, 3}};
+	std::vector<draw_batch> batches(o.pipelines);
+	for (std::size_t i = 0; i < o.meshes; ++i) {
+		batches[i % o.pipelines].add(6, 0, GLint(4 * i));
+	}
+
+	std::vector<result> results;
+
+	if (o.mode == "mesh" || o.mode == "both") {
+		results.push_back(measure("mesh", o, [&] {
+			for (std::size_t p = 0; p < pipelines.size(); ++p) {
+				pipelines[p]->use();
+				for (std::size_t i = p; i < meshes.size(); i += pipelines.size()) meshes[i].draw();
+			}
+			return meshes.size();
+		}));
+	}
+
+	if (o.mode == "batch" || o.mode == "both") {
+		results.push_back(measure("batch", o, [&] {
+			for (std::size_t p = 0; p < pipelines.size(); ++p) {
+				pipelines[p]->use();
+				shared_mesh.draw(batches[p]);
+			}
+			return meshes.size();
+		}));
+	}
+
+	std::cout << "{\n";
+	std::cout << "  \"renderer\": ";
+	detail::write_json_string(std::cout, reinterpret_cast<char const *>(gl::get_string(GL_RENDERER)));
+	std::cout << ",\n";
+	std::cout << "  \"gl_version\": " << gl::features().version << ",\n";
+	std::cout << "  \"multi_draw_indirect\": " << (gl::features().multi_draw_indirect ? "true" : "false") << ",\n";
+	std::cout << "  \"check_gl_errors\": " << (MOGGLE_CHECK_GL_ERRORS ? "true" : "false") << ",\n";
+	std::cout << "  \"count_gl_calls\": " << (MOGGLE_COUNT_GL_CALLS ? "true" : "false") << ",\n";
+	std::cout << "  \"meshes\": " << o.meshes << ",\n";
+	std::cout << "  \"pipelines\": " << o.pipelines << ",\n";
+	std::cout << "  \"frames\": " << o.frames << ",\n";
+	std::cout << "  \"results\": [\n";
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		if (i) std::cout << ",\n";
+		print(std::cout, results[i], o);
+	}
+	std::cout << "\n  ]\n";
+	std::cout << "}\n";
+}
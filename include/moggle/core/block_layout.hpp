@@ -0,0 +1,199 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "gl.hpp"
+#include "../math/matrix.hpp"
+#include "../math/normalized.hpp"
+
+namespace moggle {
+
+/// The memory layout rules for interface blocks, as defined by GLSL.
+/// std140 is used for uniform blocks, std430 for shader storage blocks.
+enum class layout_standard {
+	std140,
+	std430
+};
+
+namespace detail {
+	constexpr std::size_t align_up(std::size_t v, std::size_t alignment) {
+		return (v + alignment - 1) / alignment * alignment;
+	}
+	constexpr std::size_t max(std::size_t a, std::size_t b) {
+		return a > b ? a : b;
+	}
+}
+
+/// The alignment and size of T in an interface block using layout L, and how to write it there.
+/// \note Supports scalars, normalized types, vectors, matrices, std::arrays and std::tuples (as structs).
+template<layout_standard L, typename T, typename = void>
+struct layout_traits;
+
+#define X(T, S) \
+	template<layout_standard L> \
+	struct layout_traits<L, T> { \
+		static constexpr std::size_t alignment = sizeof(S); \
+		static constexpr std::size_t size = sizeof(S); \
+		static void write(char * out, T const & v) { \
+			S s = v; \
+			std::memcpy(out, &s, sizeof(S)); \
+		} \
+	}
+
+X(GLfloat , GLfloat );
+X(GLint   , GLint   );
+X(GLuint  , GLuint  );
+X(GLdouble, GLdouble);
+X(bool    , GLuint  );
+
+#undef X
+
+template<layout_standard L, typename T, typename F>
+struct layout_traits<L, normalized_type<T, F>> : layout_traits<L, F> {
+	static void write(char * out, normalized_type<T, F> const & v) {
+		layout_traits<L, F>::write(out, F(v));
+	}
+};
+
+// Vectors.
+template<layout_standard L, typename T>
+struct layout_traits<L, T, typename std::enable_if<matrix_traits<T>::is_matrix && matrix_traits<T>::width == 1>::type> {
+	using element = layout_traits<L, typename matrix_traits<T>::element_type>;
+	static constexpr std::size_t n = matrix_traits<T>::size;
+	static constexpr std::size_t alignment = element::size * (n == 2 ? 2 : 4);
+	static constexpr std::size_t size = element::size * n;
+	static void write(char * out, T const & v) {
+		for (std::size_t i = 0; i < n; ++i) element::write(out + i * element::size, v[i]);
+	}
+};
+
+// Matrices are stored as an array of column vectors.
+template<layout_standard L, typename T>
+struct layout_traits<L, T, typename std::enable_if<matrix_traits<T>::is_matrix && matrix_traits<T>::width != 1>::type> {
+	using element = layout_traits<L, typename matrix_traits<T>::element_type>;
+	using column = layout_traits<L, vector<typename matrix_traits<T>::element_type, matrix_traits<T>::height>>;
+	static constexpr std::size_t alignment = L == layout_standard::std140 ? detail::max(column::alignment, 16) : column::alignment;
+	static constexpr std::size_t stride = detail::align_up(column::size, alignment);
+	static constexpr std::size_t size = stride * matrix_traits<T>::width;
+	static void write(char * out, T const & m) {
+		for (std::size_t j = 0; j < matrix_traits<T>::width; ++j)
+		for (std::size_t i = 0; i < matrix_traits<T>::height; ++i) {
+			element::write(out + j * stride + i * element::size, m(i, j));
+		}
+	}
+};
+
+template<layout_standard L, typename T, std::size_t N>
+struct layout_traits<L, std::array<T, N>> {
+	using element = layout_traits<L, T>;
+	static constexpr std::size_t alignment = L == layout_standard::std140 ? detail::max(element::alignment, 16) : element::alignment;
+	static constexpr std::size_t stride = detail::align_up(element::size, alignment);
+	static constexpr std::size_t size = stride * N;
+	static void write(char * out, std::array<T, N> const & a) {
+		for (std::size_t i = 0; i < N; ++i) element::write(out + i * stride, a[i]);
+	}
+};
+
+namespace detail {
+	template<layout_standard L, std::size_t I, typename... Members>
+	struct block_offset {
+		using previous = layout_traits<L, typename std::tuple_element<I - 1, std::tuple<Members...>>::type>;
+		using current = layout_traits<L, typename std::tuple_element<I, std::tuple<Members...>>::type>;
+		static constexpr std::size_t value = align_up(block_offset<L, I - 1, Members...>::value + previous::size, current::alignment);
+	};
+
+	template<layout_standard L, typename... Members>
+	struct block_offset<L, 0, Members...> {
+		static constexpr std::size_t value = 0;
+	};
+
+	template<layout_standard L, typename... Members>
+	struct block_alignment;
+
+	template<layout_standard L>
+	struct block_alignment<L> {
+		static constexpr std::size_t value = L == layout_standard::std140 ? 16 : 1;
+	};
+
+	template<layout_standard L, typename First, typename... Rest>
+	struct block_alignment<L, First, Rest...> {
+		static constexpr std::size_t value = max(layout_traits<L, First>::alignment, block_alignment<L, Rest...>::value);
+	};
+}
+
+/// The layout of a block (or struct) with the given member types, in the order they are declared in GLSL.
+template<layout_standard L, typename... Members>
+struct block_layout {
+
+	static_assert(sizeof...(Members) > 0, "A block needs at least one member.");
+
+	static constexpr std::size_t count = sizeof...(Members);
+
+	template<std::size_t I>
+	using member_type = typename std::tuple_element<I, std::tuple<Members...>>::type;
+
+	template<std::size_t I>
+	static constexpr std::size_t offset() { return detail::block_offset<L, I, Members...>::value; }
+
+	static constexpr std::size_t alignment = detail::block_alignment<L, Members...>::value;
+
+	/// The number of bytes up to and including the last member.
+	static constexpr std::size_t size = offset<count - 1>() + layout_traits<L, member_type<count - 1>>::size;
+
+	/// The size including padding at the end, as used for structs and arrays of structs.
+	static constexpr std::size_t padded_size = detail::align_up(size, alignment);
+
+	template<std::size_t I>
+	static void write(char * block, member_type<I> const & v) {
+		layout_traits<L, member_type<I>>::write(block + offset<I>(), v);
+	}
+
+	static void write_all(char * block, std::tuple<Members...> const & v) {
+		write_from<0>(block, v, std::integral_constant<bool, count == 0>());
+	}
+
+private:
+	template<std::size_t I>
+	static void write_from(char * block, std::tuple<Members...> const & v, std::false_type) {
+		write<I>(block, std::get<I>(v));
+		write_from<I + 1>(block, v, std::integral_constant<bool, I + 1 == count>());
+	}
+
+	template<std::size_t I>
+	static void write_from(char *, std::tuple<Members...> const &, std::true_type) {}
+
+};
+
+// Structs.
+template<layout_standard L, typename... Members>
+struct layout_traits<L, std::tuple<Members...>> {
+	using block = block_layout<L, Members...>;
+	static constexpr std::size_t alignment = block::alignment;
+	static constexpr std::size_t size = block::padded_size;
+	static void write(char * out, std::tuple<Members...> const & v) {
+		block::write_all(out, v);
+	}
+};
+
+}
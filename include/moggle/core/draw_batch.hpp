@@ -0,0 +1,103 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gl.hpp"
+#include "gl_type_traits.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// The layout of one command in a GL_DRAW_INDIRECT_BUFFER, as read by glMultiDrawElementsIndirect.
+struct draw_elements_indirect_command {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+/// Indexed draws sharing a program and buffers, submitted with a single glMultiDrawElementsIndirect when available.
+/// \note Every draw gets its own range of instances, so per-draw data can be an attribute with divisor 1.
+class draw_batch {
+
+private:
+	std::vector<draw_elements_indirect_command> commands_;
+	GLuint instances_ = 0;
+	vbo<draw_elements_indirect_command> vbo_;
+	bool dirty_ = false;
+
+public:
+	/// Adds a draw of count indices, starting at first_index.
+	/// \return The draw id, which is also the index of its command.
+	std::size_t add(GLuint count, GLuint first_index, GLint base_vertex = 0, GLuint instance_count = 1) {
+		commands_.push_back({count, instance_count, first_index, base_vertex, instances_});
+		instances_ += instance_count;
+		dirty_ = true;
+		return commands_.size() - 1;
+	}
+
+	/// Removes all draws, but keeps the buffer storage.
+	void clear() {
+		commands_.clear();
+		instances_ = 0;
+		dirty_ = true;
+	}
+
+	std::vector<draw_elements_indirect_command> const & commands() const { return commands_; }
+
+	std::size_t size() const { return commands_.size(); }
+	bool empty() const { return commands_.empty(); }
+
+	/// The total number of instances over all draws, e.g. the number of elements needed in a per-draw attribute.
+	GLuint instance_count() const { return instances_; }
+
+	/// Draws everything. The vertex array and element array buffer must be bound.
+	/// \param index_type GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	void submit(GLenum mode, GLenum index_type, std::function<void(std::size_t draw_id)> const & set_draw_id = nullptr) {
+		if (commands_.empty()) return;
+		if (gl::features().multi_draw_indirect) {
+			if (dirty_) {
+				vbo_.clear();
+				vbo_.append(commands_);
+				dirty_ = false;
+			}
+			vbo_.bind(GL_DRAW_INDIRECT_BUFFER);
+			gl::multi_draw_elements_indirect(mode, index_type, nullptr, commands_.size(), 0);
+			return;
+		}
+		std::size_t index_size = gl_type_size(index_type);
+		for (std::size_t i = 0; i < commands_.size(); ++i) {
+			auto const & c = commands_[i];
+			if (set_draw_id) set_draw_id(i);
+			void const * offset = reinterpret_cast<void const *>(c.first_index * index_size);
+			if (gl::features().base_instance) {
+				gl::draw_elements_instanced_base_vertex_base_instance(mode, c.count, index_type, offset, c.instance_count, c.base_vertex, c.base_instance);
+			} else {
+				gl::draw_elements_instanced_base_vertex(mode, c.count, index_type, offset, c.instance_count, c.base_vertex);
+			}
+		}
+	}
+
+};
+
+}
@@ -0,0 +1,80 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <utility>
+
+#include "gl.hpp"
+
+namespace moggle {
+
+/// A sync object, to find out when the GPU has finished all commands issued before it.
+class fence {
+
+private:
+	GLsync sync_ = nullptr;
+
+public:
+	fence() {}
+
+	~fence() { clear(); }
+
+	fence(fence const &) = delete;
+	fence & operator = (fence const &) = delete;
+
+	fence(fence && f) : sync_(f.sync_) { f.sync_ = nullptr; }
+	fence & operator = (fence && f) { std::swap(sync_, f.sync_); return *this; }
+
+	bool inserted() const { return sync_; }
+	explicit operator bool() const { return inserted(); }
+
+	/// Inserts the fence in the command stream, replacing the previous one (if any).
+	void insert() {
+		clear();
+		sync_ = gl::fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void clear() {
+		if (sync_) gl::delete_sync(sync_);
+		sync_ = nullptr;
+	}
+
+	/// Whether the GPU has passed the fence. Does not wait.
+	/// A fence that was never inserted is always signaled.
+	bool signaled() const {
+		if (!sync_) return true;
+		GLenum r = gl::client_wait_sync(sync_, 0, 0);
+		if (r == GL_WAIT_FAILED) throw gl_error{"gl::client_wait_sync", "Waiting for fence failed."};
+		return r != GL_TIMEOUT_EXPIRED;
+	}
+
+	/// Waits until the GPU has passed the fence.
+	void wait() const {
+		if (!sync_) return;
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (true) {
+			GLenum r = gl::client_wait_sync(sync_, flags, GLuint64(1000000000));
+			if (r == GL_WAIT_FAILED) throw gl_error{"gl::client_wait_sync", "Waiting for fence failed."};
+			if (r != GL_TIMEOUT_EXPIRED) return;
+			flags = 0;
+		}
+	}
+
+};
+
+}
@@ -0,0 +1,323 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "readback.hpp"
+#include "texture.hpp"
+
+namespace moggle {
+
+class renderbuffer {
+
+private:
+	mutable GLuint id = 0;
+	GLenum internal_format_ = 0;
+	GLsizei width_ = 0;
+	GLsizei height_ = 0;
+	GLsizei samples_ = 0;
+
+	static bool dsa() { return gl::features().direct_state_access; }
+
+public:
+	explicit renderbuffer(bool create_now = false) {
+		if (create_now) create();
+	}
+
+	renderbuffer(GLenum internal_format, GLsizei width, GLsizei height, GLsizei samples = 0) {
+		storage(internal_format, width, height, samples);
+	}
+
+	~renderbuffer() { destroy(); }
+
+	renderbuffer(renderbuffer const &) = delete;
+	renderbuffer & operator = (renderbuffer const &) = delete;
+
+	renderbuffer(renderbuffer && r)
+		: id(r.id), internal_format_(r.internal_format_), width_(r.width_), height_(r.height_), samples_(r.samples_) {
+		r.id = 0;
+	}
+
+	renderbuffer & operator = (renderbuffer && r) {
+		std::swap(id, r.id);
+		std::swap(internal_format_, r.internal_format_);
+		std::swap(width_, r.width_);
+		std::swap(height_, r.height_);
+		std::swap(samples_, r.samples_);
+		return *this;
+	}
+
+	bool created() const { return id; }
+	explicit operator bool() const { return created(); }
+
+	void create() const {
+		if (id) return;
+		if (dsa()) gl::create_renderbuffers(1, &id);
+		else gl::generate_renderbuffers(1, &id);
+	}
+
+	void destroy() { gl::delete_renderbuffers(1, &id); id = 0; }
+
+	GLuint name() const { return id; }
+	GLenum internal_format() const { return internal_format_; }
+	GLsizei width() const { return width_; }
+	GLsizei height() const { return height_; }
+	GLsizei samples() const { return samples_; }
+
+	/// (Re)allocates the storage.
+	/// \param samples The number of samples for multisampling, or 0.
+	void storage(GLenum internal_format, GLsizei width, GLsizei height, GLsizei samples = 0) {
+		create();
+		if (dsa()) {
+			if (samples) gl::named_renderbuffer_storage_multisample(id, samples, internal_format, width, height);
+			else gl::named_renderbuffer_storage(id, internal_format, width, height);
+		} else {
+			gl::bind_renderbuffer(GL_RENDERBUFFER, id);
+			if (samples) gl::renderbuffer_storage_multisample(GL_RENDERBUFFER, samples, internal_format, width, height);
+			else gl::renderbuffer_storage(GL_RENDERBUFFER, internal_format, width, height);
+		}
+		internal_format_ = internal_format;
+		width_ = width;
+		height_ = height;
+		samples_ = samples;
+	}
+
+};
+
+/// When the contents of an attachment of a framebuffer may be discarded (see framebuffer::invalidation()).
+enum class invalidation {
+	never = 0,
+	on_bind = 1, // The previous contents are not needed, e.g. because the attachment is always cleared first.
+	on_unbind = 2, // The contents are not needed after the pass, e.g. a depth buffer only used while rendering.
+	on_bind_and_unbind = 3
+};
+
+class framebuffer {
+
+private:
+	mutable GLuint id = 0;
+	std::vector<GLenum> invalidate_on_bind_;
+	std::vector<GLenum> invalidate_on_unbind_;
+
+	static bool dsa() { return gl::features().direct_state_access; }
+
+	static char const * status_message(GLenum status) {
+		switch (status) {
+			case GL_FRAMEBUFFER_UNDEFINED: return "Undefined framebuffer.";
+			case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT: return "Incomplete attachment.";
+			case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT: return "Missing attachment.";
+			case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER: return "Incomplete draw buffer.";
+			case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER: return "Incomplete read buffer.";
+			case GL_FRAMEBUFFER_UNSUPPORTED: return "Unsupported combination of formats.";
+			case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE: return "Inconsistent number of samples.";
+			case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS: return "Inconsistent layers.";
+			default: return "Incomplete framebuffer.";
+		}
+	}
+
+	// Without direct state access, framebuffers are bound to GL_DRAW_FRAMEBUFFER to edit them.
+	void bind_to_edit() const {
+		create();
+		gl::bind_framebuffer(GL_DRAW_FRAMEBUFFER, id);
+	}
+
+	static void set_policy(std::vector<GLenum> & list, GLenum attachment, bool enable) {
+		list.erase(std::remove(list.begin(), list.end(), attachment), list.end());
+		if (enable) list.push_back(attachment);
+	}
+
+public:
+	explicit framebuffer(bool create_now = false) {
+		if (create_now) create();
+	}
+
+	~framebuffer() { destroy(); }
+
+	framebuffer(framebuffer const &) = delete;
+	framebuffer & operator = (framebuffer const &) = delete;
+
+	framebuffer(framebuffer && f)
+		: id(f.id), invalidate_on_bind_(std::move(f.invalidate_on_bind_)), invalidate_on_unbind_(std::move(f.invalidate_on_unbind_)) {
+		f.id = 0;
+	}
+
+	framebuffer & operator = (framebuffer && f) {
+		std::swap(id, f.id);
+		std::swap(invalidate_on_bind_, f.invalidate_on_bind_);
+		std::swap(invalidate_on_unbind_, f.invalidate_on_unbind_);
+		return *this;
+	}
+
+	bool created() const { return id; }
+	explicit operator bool() const { return created(); }
+
+	void create() const {
+		if (id) return;
+		if (dsa()) gl::create_framebuffers(1, &id);
+		else gl::generate_framebuffers(1, &id);
+	}
+
+	void destroy() { gl::delete_framebuffers(1, &id); id = 0; }
+
+	GLuint name() const { return id; }
+
+	/// Attaches a level of a texture, e.g. to GL_COLOR_ATTACHMENT0 or GL_DEPTH_ATTACHMENT.
+	void attach(GLenum attachment, texture const & t, GLint level = 0) {
+		t.create();
+		if (dsa()) {
+			create();
+			gl::named_framebuffer_texture(id, attachment, t.name(), level);
+		} else {
+			bind_to_edit();
+			gl::framebuffer_texture_2d(GL_DRAW_FRAMEBUFFER, attachment, t.target(), t.name(), level);
+		}
+	}
+
+	void attach(GLenum attachment, renderbuffer const & r) {
+		r.create();
+		if (dsa()) {
+			create();
+			gl::named_framebuffer_renderbuffer(id, attachment, GL_RENDERBUFFER, r.name());
+		} else {
+			bind_to_edit();
+			gl::framebuffer_renderbuffer(GL_DRAW_FRAMEBUFFER, attachment, GL_RENDERBUFFER, r.name());
+		}
+	}
+
+	void detach(GLenum attachment) {
+		if (dsa()) {
+			create();
+			gl::named_framebuffer_renderbuffer(id, attachment, GL_RENDERBUFFER, 0);
+		} else {
+			bind_to_edit();
+			gl::framebuffer_renderbuffer(GL_DRAW_FRAMEBUFFER, attachment, GL_RENDERBUFFER, 0);
+		}
+		set_policy(invalidate_on_bind_, attachment, false);
+		set_policy(invalidate_on_unbind_, attachment, false);
+	}
+
+	/// Selects the color attachments that are drawn to. By default, only GL_COLOR_ATTACHMENT0 is.
+	void draw_buffers(std::initializer_list<GLenum> buffers) {
+		if (dsa()) {
+			create();
+			gl::named_framebuffer_draw_buffers(id, buffers.size(), buffers.begin());
+		} else {
+			bind_to_edit();
+			gl::draw_buffers(buffers.size(), buffers.begin());
+		}
+	}
+
+	GLenum status() const {
+		if (dsa()) {
+			create();
+			return gl::check_named_framebuffer_status(id, GL_DRAW_FRAMEBUFFER);
+		} else {
+			bind_to_edit();
+			return gl::check_framebuffer_status(GL_DRAW_FRAMEBUFFER);
+		}
+	}
+
+	bool complete() const { return status() == GL_FRAMEBUFFER_COMPLETE; }
+
+	/// \throws gl_error if the framebuffer is not complete.
+	void check() const {
+		GLenum s = status();
+		if (s != GL_FRAMEBUFFER_COMPLETE) throw gl_error{"framebuffer::check", status_message(s)};
+	}
+
+	/// Sets when the contents of an attachment may be discarded, to save memory bandwidth on
+	/// (mostly tiled) GPUs. Transient attachments, such as a depth buffer that is only used
+	/// during a single pass, should be invalidated on unbind().
+	/// \note Does nothing on contexts without glInvalidateFramebuffer.
+	void invalidation(GLenum attachment, moggle::invalidation when) {
+		set_policy(invalidate_on_bind_, attachment, int(when) & int(moggle::invalidation::on_bind));
+		set_policy(invalidate_on_unbind_, attachment, int(when) & int(moggle::invalidation::on_unbind));
+	}
+
+	/// Discards the contents of the given attachments.
+	void invalidate(std::vector<GLenum> const & attachments) const {
+		if (!gl::features().invalidate_framebuffer || attachments.empty()) return;
+		if (dsa()) {
+			create();
+			gl::invalidate_named_framebuffer_data(id, attachments.size(), attachments.data());
+		} else {
+			bind_to_edit();
+			gl::invalidate_framebuffer(GL_DRAW_FRAMEBUFFER, attachments.size(), attachments.data());
+		}
+	}
+
+	/// Binds the framebuffer, and invalidates the attachments that are invalidated on bind.
+	void bind(GLenum target = GL_FRAMEBUFFER) const {
+		create();
+		gl::bind_framebuffer(target, id);
+		if (target != GL_READ_FRAMEBUFFER) invalidate(invalidate_on_bind_);
+	}
+
+	/// Invalidates the attachments that are invalidated on unbind, and binds the default framebuffer.
+	void unbind(GLenum target = GL_FRAMEBUFFER) const {
+		if (target != GL_READ_FRAMEBUFFER) invalidate(invalidate_on_unbind_);
+		gl::bind_framebuffer(target, 0);
+	}
+
+	/// Starts reading back a rectangle of pixels from the read buffer (GL_COLOR_ATTACHMENT0 by default),
+	/// without waiting for the GPU to finish drawing them.
+	/// \note This leaves the framebuffer bound to GL_READ_FRAMEBUFFER.
+	void read_pixels(readback & r, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type) const {
+		bind(GL_READ_FRAMEBUFFER);
+		r.start_pixels(x, y, width, height, format, type);
+	}
+
+	/// Copies a rectangle of pixels from one framebuffer to another.
+	/// \param from, to Framebuffer names, where 0 is the default framebuffer.
+	/// \param mask A combination of GL_COLOR_BUFFER_BIT, GL_DEPTH_BUFFER_BIT and GL_STENCIL_BUFFER_BIT.
+	/// \note Without direct state access, this leaves both framebuffers bound.
+	static void blit(
+		GLuint from, GLint x0, GLint y0, GLint x1, GLint y1,
+		GLuint to, GLint dx0, GLint dy0, GLint dx1, GLint dy1,
+		GLbitfield mask = GL_COLOR_BUFFER_BIT, GLenum filter = GL_NEAREST
+	) {
+		if (gl::features().direct_state_access) {
+			gl::blit_named_framebuffer(from, to, x0, y0, x1, y1, dx0, dy0, dx1, dy1, mask, filter);
+		} else {
+			gl::bind_framebuffer(GL_READ_FRAMEBUFFER, from);
+			gl::bind_framebuffer(GL_DRAW_FRAMEBUFFER, to);
+			gl::blit_framebuffer(x0, y0, x1, y1, dx0, dy0, dx1, dy1, mask, filter);
+		}
+	}
+
+	/// Copies the rectangle (0, 0)-(width, height) to the same place in another framebuffer.
+	void blit_to(framebuffer const & to, GLint width, GLint height, GLbitfield mask = GL_COLOR_BUFFER_BIT, GLenum filter = GL_NEAREST) const {
+		create();
+		to.create();
+		blit(id, 0, 0, width, height, to.id, 0, 0, width, height, mask, filter);
+	}
+
+	/// Copies the rectangle (0, 0)-(width, height) to the same place in the default framebuffer.
+	void blit_to_default(GLint width, GLint height, GLbitfield mask = GL_COLOR_BUFFER_BIT, GLenum filter = GL_NEAREST) const {
+		create();
+		blit(id, 0, 0, width, height, 0, 0, 0, width, height, mask, filter);
+	}
+
+};
+
+}
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -35,6 +36,10 @@
 #endif
 #endif
 
+#ifndef MOGGLE_COUNT_GL_CALLS
+#define MOGGLE_COUNT_GL_CALLS 0
+#endif
+
 namespace moggle {
 
 struct gl_error : std::runtime_error {
@@ -44,12 +49,6 @@ struct gl_error : std::runtime_error {
 
 namespace gl {
 
-	inline void init() {
-		#ifdef GLEW_VERSION
-		if (glewInit() != GLEW_OK) throw gl_error{"glewInit", "GLEW initialisation failed."};
-		#endif
-	}
-
 	inline void throw_error(std::string const & function) {
 		switch (glGetError()) {
 			case GL_NO_ERROR                     : return;
@@ -76,64 +75,197 @@ namespace gl {
 	#endif
 	};
 
+	/// The number of calls made through the gl:: wrappers on this thread.
+	/// \note Only counted when MOGGLE_COUNT_GL_CALLS is enabled.
+	inline unsigned long long & call_count() {
+		static thread_local unsigned long long n = 0;
+		return n;
+	}
+
+	inline void count_call() {
+	#if MOGGLE_COUNT_GL_CALLS
+		++call_count();
+	#endif
+	}
+
 	#define X(name, gl) \
 		template<typename... Args> \
 		inline decltype(gl(std::declval<Args>()...)) \
 		name(Args && ... args) { \
+			count_call(); \
 			error_checker c{#gl " (gl::" #name ")"}; \
 			return gl(std::forward<Args>(args)...); \
 		}
 
 	X(active_texture                , glActiveTexture          )
 	X(attach_shader                 , glAttachShader           )
+	X(begin_conditional_render      , glBeginConditionalRender )
+	X(begin_query                   , glBeginQuery             )
+	X(begin_transform_feedback      , glBeginTransformFeedback )
 	X(bind_attribute_location       , glBindAttribLocation     )
 	X(bind_buffer                   , glBindBuffer             )
+	X(bind_buffer_base              , glBindBufferBase         )
+	X(bind_buffer_range             , glBindBufferRange        )
 	X(bind_framebuffer              , glBindFramebuffer        )
+	X(bind_image_texture            , glBindImageTexture       )
 	X(bind_renderbuffer             , glBindRenderbuffer       )
 	X(bind_texture                  , glBindTexture            )
+	X(bind_texture_unit             , glBindTextureUnit        )
 	X(bind_vertex_array             , glBindVertexArray        )
+	X(bind_vertex_buffer            , glBindVertexBuffer       )
 	X(blend_equation                , glBlendEquation          )
 	X(blend_function                , glBlendFunc              )
+	X(blit_framebuffer              , glBlitFramebuffer        )
+	X(blit_named_framebuffer        , glBlitNamedFramebuffer   )
 	X(buffer_data                   , glBufferData             )
+	X(buffer_storage                , glBufferStorage          )
+	X(buffer_sub_data               , glBufferSubData          )
+	X(check_framebuffer_status      , glCheckFramebufferStatus )
+	X(check_named_framebuffer_status , glCheckNamedFramebufferStatus)
 	X(clear                         , glClear                  )
 	X(clear_color                   , glClearColor             )
+	X(client_wait_sync              , glClientWaitSync         )
+	X(color_mask                    , glColorMask              )
 	X(compile_shader                , glCompileShader          )
+	X(copy_buffer_sub_data          , glCopyBufferSubData      )
+	X(copy_named_buffer_sub_data    , glCopyNamedBufferSubData )
+	X(create_buffers                , glCreateBuffers          )
+	X(create_framebuffers           , glCreateFramebuffers     )
 	X(create_program                , glCreateProgram          )
+	X(create_renderbuffers          , glCreateRenderbuffers    )
 	X(create_shader                 , glCreateShader           )
+	X(create_textures               , glCreateTextures         )
+	X(create_vertex_arrays          , glCreateVertexArrays     )
 	X(delete_buffers                , glDeleteBuffers          )
 	X(delete_framebuffers           , glDeleteFramebuffers     )
 	X(delete_program                , glDeleteProgram          )
+	X(delete_queries                , glDeleteQueries          )
 	X(delete_renderbuffers          , glDeleteRenderbuffers    )
 	X(delete_shader                 , glDeleteShader           )
+	X(delete_sync                   , glDeleteSync             )
 	X(delete_textures               , glDeleteTextures         )
 	X(delete_vertex_arrays          , glDeleteVertexArrays     )
+	X(depth_mask                    , glDepthMask              )
 	X(disable                       , glDisable                )
+	X(dispatch_compute              , glDispatchCompute        )
+	X(dispatch_compute_indirect     , glDispatchComputeIndirect)
 	X(draw_arrays                   , glDrawArrays             )
+	X(draw_arrays_instanced         , glDrawArraysInstanced    )
+	X(draw_buffers                  , glDrawBuffers            )
 	X(draw_elements                 , glDrawElements           )
+	X(draw_elements_base_vertex     , glDrawElementsBaseVertex )
+	X(draw_elements_instanced       , glDrawElementsInstanced  )
+	X(draw_elements_instanced_base_vertex , glDrawElementsInstancedBaseVertex)
+	X(draw_elements_instanced_base_vertex_base_instance , glDrawElementsInstancedBaseVertexBaseInstance)
 	X(enable                        , glEnable                 )
+	X(enable_vertex_array_attribute , glEnableVertexArrayAttrib)
 	X(enable_vertex_attribute_array , glEnableVertexAttribArray)
+	X(end_conditional_render        , glEndConditionalRender   )
+	X(end_query                     , glEndQuery               )
+	X(end_transform_feedback        , glEndTransformFeedback   )
+	X(fence_sync                    , glFenceSync              )
+	X(finish                        , glFinish                 )
+	X(flush                         , glFlush                  )
+	X(flush_mapped_buffer_range     , glFlushMappedBufferRange )
+	X(flush_mapped_named_buffer_range , glFlushMappedNamedBufferRange)
 	X(framebuffer_renderbuffer      , glFramebufferRenderbuffer)
 	X(framebuffer_texture_2d        , glFramebufferTexture2D   )
 	X(generate_buffers              , glGenBuffers             )
 	X(generate_framebuffers         , glGenFramebuffers        )
+	X(generate_mipmap               , glGenerateMipmap         )
+	X(generate_named_texture_mipmap , glGenerateTextureMipmap  )
+	X(generate_queries              , glGenQueries             )
 	X(generate_renderbuffers        , glGenRenderbuffers       )
 	X(generate_textures             , glGenTextures            )
 	X(generate_vertex_arrays        , glGenVertexArrays        )
+	X(get_active_attribute          , glGetActiveAttrib        )
+	X(get_active_uniform            , glGetActiveUniform       )
+	X(get_active_uniform_block_iv   , glGetActiveUniformBlockiv)
+	X(get_attribute_location        , glGetAttribLocation      )
+	X(get_buffer_sub_data           , glGetBufferSubData       )
+	X(get_integer_64v               , glGetInteger64v          )
+	X(get_integer_v                 , glGetIntegerv            )
+	X(get_named_buffer_sub_data     , glGetNamedBufferSubData  )
+	X(get_program_binary            , glGetProgramBinary       )
 	X(get_program_info_log          , glGetProgramInfoLog      )
 	X(get_program_iv                , glGetProgramiv           )
+	X(get_program_resource_index    , glGetProgramResourceIndex)
+	X(get_query_object_iv           , glGetQueryObjectiv       )
+	X(get_query_object_ui64v        , glGetQueryObjectui64v    )
 	X(get_shader_info_log           , glGetShaderInfoLog       )
 	X(get_shader_iv                 , glGetShaderiv            )
+	X(get_string                    , glGetString              )
+	X(get_string_i                  , glGetStringi             )
+	X(get_uniform_block_index       , glGetUniformBlockIndex   )
 	X(get_uniform_location          , glGetUniformLocation     )
+	X(invalidate_framebuffer        , glInvalidateFramebuffer  )
+	X(invalidate_named_framebuffer_data , glInvalidateNamedFramebufferData)
+	X(is_enabled                    , glIsEnabled              )
 	X(link_program                  , glLinkProgram            )
 	X(map_buffer                    , glMapBuffer              )
+	X(map_buffer_range              , glMapBufferRange         )
+	X(map_named_buffer              , glMapNamedBuffer         )
+	X(map_named_buffer_range        , glMapNamedBufferRange    )
+	X(memory_barrier                , glMemoryBarrier          )
+	X(memory_barrier_by_region      , glMemoryBarrierByRegion  )
+	X(multi_draw_elements_indirect  , glMultiDrawElementsIndirect)
+	X(named_buffer_data             , glNamedBufferData        )
+	X(named_buffer_storage          , glNamedBufferStorage     )
+	X(named_buffer_sub_data         , glNamedBufferSubData     )
+	X(named_framebuffer_draw_buffers , glNamedFramebufferDrawBuffers)
+	X(named_framebuffer_renderbuffer , glNamedFramebufferRenderbuffer)
+	X(named_framebuffer_texture     , glNamedFramebufferTexture)
+	X(named_renderbuffer_storage    , glNamedRenderbufferStorage)
+	X(named_renderbuffer_storage_multisample , glNamedRenderbufferStorageMultisample)
+	X(named_texture_parameter_f     , glTextureParameterf      )
+	X(named_texture_parameter_i     , glTextureParameteri      )
+	X(named_texture_storage_2d      , glTextureStorage2D       )
+	X(named_texture_sub_image_2d    , glTextureSubImage2D      )
+	X(pixel_store_i                 , glPixelStorei            )
+	X(program_binary                , glProgramBinary          )
+	X(program_parameter_i           , glProgramParameteri      )
+	X(program_uniform_1f            , glProgramUniform1f       )
+	X(program_uniform_1fv           , glProgramUniform1fv      )
+	X(program_uniform_1i            , glProgramUniform1i       )
+	X(program_uniform_1iv           , glProgramUniform1iv      )
+	X(program_uniform_1ui           , glProgramUniform1ui      )
+	X(program_uniform_1uiv          , glProgramUniform1uiv     )
+	X(program_uniform_2fv           , glProgramUniform2fv      )
+	X(program_uniform_2iv           , glProgramUniform2iv      )
+	X(program_uniform_2uiv          , glProgramUniform2uiv     )
+	X(program_uniform_3fv           , glProgramUniform3fv      )
+	X(program_uniform_3iv           , glProgramUniform3iv      )
+	X(program_uniform_3uiv          , glProgramUniform3uiv     )
+	X(program_uniform_4fv           , glProgramUniform4fv      )
+	X(program_uniform_4iv           , glProgramUniform4iv      )
+	X(program_uniform_4uiv          , glProgramUniform4uiv     )
+	X(program_uniform_matrix_2fv    , glProgramUniformMatrix2fv)
+	X(program_uniform_matrix_2x3fv  , glProgramUniformMatrix2x3fv)
+	X(program_uniform_matrix_2x4fv  , glProgramUniformMatrix2x4fv)
+	X(program_uniform_matrix_3fv    , glProgramUniformMatrix3fv)
+	X(program_uniform_matrix_3x2fv  , glProgramUniformMatrix3x2fv)
+	X(program_uniform_matrix_3x4fv  , glProgramUniformMatrix3x4fv)
+	X(program_uniform_matrix_4fv    , glProgramUniformMatrix4fv)
+	X(program_uniform_matrix_4x2fv  , glProgramUniformMatrix4x2fv)
+	X(program_uniform_matrix_4x3fv  , glProgramUniformMatrix4x3fv)
+	X(query_counter                 , glQueryCounter           )
+	X(read_pixels                   , glReadPixels             )
 	X(renderbuffer_storage          , glRenderbufferStorage    )
+	X(renderbuffer_storage_multisample , glRenderbufferStorageMultisample)
 	X(shader_source                 , glShaderSource           )
+	X(shader_storage_block_binding  , glShaderStorageBlockBinding)
 	X(texture_image_2d              , glTexImage2D             )
 	X(texture_parameter_f           , glTexParameterf          )
 	X(texture_parameter_i           , glTexParameteri          )
+	X(texture_storage_2d            , glTexStorage2D           )
+	X(texture_sub_image_2d          , glTexSubImage2D          )
+	X(transform_feedback_varyings   , glTransformFeedbackVaryings)
 	X(uniform_1f                    , glUniform1f              )
+	X(uniform_1fv                   , glUniform1fv             )
 	X(uniform_1i                    , glUniform1i              )
+	X(uniform_1iv                   , glUniform1iv             )
 	X(uniform_1ui                   , glUniform1ui             )
+	X(uniform_1uiv                  , glUniform1uiv            )
 	X(uniform_2fv                   , glUniform2fv             )
 	X(uniform_2iv                   , glUniform2iv             )
 	X(uniform_2uiv                  , glUniform2uiv            )
@@ -143,6 +275,7 @@ namespace gl {
 	X(uniform_4fv                   , glUniform4fv             )
 	X(uniform_4iv                   , glUniform4iv             )
 	X(uniform_4uiv                  , glUniform4uiv            )
+	X(uniform_block_binding         , glUniformBlockBinding    )
 	X(uniform_matrix_2fv            , glUniformMatrix2fv       )
 	X(uniform_matrix_2x3fv          , glUniformMatrix2x3fv     )
 	X(uniform_matrix_2x4fv          , glUniformMatrix2x4fv     )
@@ -153,10 +286,98 @@ namespace gl {
 	X(uniform_matrix_4x2fv          , glUniformMatrix4x2fv     )
 	X(uniform_matrix_4x3fv          , glUniformMatrix4x3fv     )
 	X(unmap_buffer                  , glUnmapBuffer            )
+	X(unmap_named_buffer            , glUnmapNamedBuffer       )
 	X(use_program                   , glUseProgram             )
+	X(vertex_array_attribute_binding , glVertexArrayAttribBinding)
+	X(vertex_array_attribute_format , glVertexArrayAttribFormat)
+	X(vertex_array_binding_divisor  , glVertexArrayBindingDivisor)
+	X(vertex_array_vertex_buffer    , glVertexArrayVertexBuffer)
+	X(vertex_attribute_binding      , glVertexAttribBinding    )
+	X(vertex_attribute_divisor      , glVertexAttribDivisor    )
+	X(vertex_attribute_format       , glVertexAttribFormat     )
 	X(vertex_attribute_pointer      , glVertexAttribPointer    )
+	X(vertex_binding_divisor        , glVertexBindingDivisor   )
 	X(viewport                      , glViewport               )
 
+	#ifdef GL_KHR_parallel_shader_compile
+	X(max_shader_compiler_threads   , glMaxShaderCompilerThreadsKHR)
+	#endif
+
 	#undef X
+
+	/// The optional features that are available in the current context.
+	/// These are detected by gl::init(). Before that, everything is assumed to be unavailable.
+	struct feature_set {
+		unsigned int version = 0; // For example, 43 for OpenGL 4.3.
+		bool buffer_storage = false;
+		bool direct_state_access = false; // Editing objects without binding them (glNamedBufferData, etc.).
+		bool program_uniform = false; // Setting uniforms without using the program (glProgramUniform*).
+		bool program_binary = false; // Retrieving and loading linked programs (glGetProgramBinary, glProgramBinary).
+		bool parallel_shader_compile = false; // Compiling and linking in the background (KHR_parallel_shader_compile).
+		bool instanced_arrays = false; // Attributes that advance per instance (glVertexAttribDivisor).
+		bool base_instance = false; // Drawing with a base instance (glDrawElementsInstancedBaseVertexBaseInstance).
+		bool multi_draw_indirect = false; // Drawing many commands from a buffer at once (glMultiDrawElementsIndirect).
+		bool texture_storage = false; // Immutable texture storage (glTexStorage2D).
+		bool invalidate_framebuffer = false; // Discarding framebuffer contents (glInvalidateFramebuffer).
+		bool vertex_attrib_binding = false; // Separate vertex formats and buffer bindings (glVertexAttribFormat, glBindVertexBuffer).
+		bool compute_shader = false; // Compute shaders (glDispatchCompute), shader storage buffers and image load/store.
+		bool conservative_occlusion_query = false; // GL_ANY_SAMPLES_PASSED_CONSERVATIVE queries.
+	};
+
+	namespace detail {
+		inline feature_set & features() {
+			static feature_set f;
+			return f;
+		}
+	}
+
+	inline feature_set const & features() {
+		return detail::features();
+	}
+
+	inline bool has_extension(char const * name) {
+		GLint n = 0;
+		get_integer_v(GL_NUM_EXTENSIONS, &n);
+		for (GLint i = 0; i < n; ++i) {
+			char const * e = reinterpret_cast<char const *>(get_string_i(GL_EXTENSIONS, i));
+			if (e && std::strcmp(e, name) == 0) return true;
+		}
+		return false;
+	}
+
+	inline void init() {
+		#ifdef GLEW_VERSION
+		if (glewInit() != GLEW_OK) throw gl_error{"glewInit", "GLEW initialisation failed."};
+		glGetError(); // glewInit() can leave an error behind on core profile contexts.
+		#endif
+		GLint major = 0, minor = 0;
+		get_integer_v(GL_MAJOR_VERSION, &major);
+		get_integer_v(GL_MINOR_VERSION, &minor);
+		feature_set & f = detail::features();
+		f.version = major * 10 + minor;
+		f.buffer_storage = f.version >= 44 || has_extension("GL_ARB_buffer_storage");
+		f.direct_state_access = f.version >= 45 || has_extension("GL_ARB_direct_state_access");
+		f.program_uniform = f.version >= 41 || has_extension("GL_ARB_separate_shader_objects");
+		if (f.version >= 41 || has_extension("GL_ARB_get_program_binary")) {
+			GLint formats = 0;
+			get_integer_v(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			f.program_binary = formats > 0;
+		}
+		f.instanced_arrays = f.version >= 33 || has_extension("GL_ARB_instanced_arrays");
+		f.base_instance = f.version >= 42 || has_extension("GL_ARB_base_instance");
+		f.multi_draw_indirect = f.version >= 43 || has_extension("GL_ARB_multi_draw_indirect");
+		f.texture_storage = f.version >= 42 || has_extension("GL_ARB_texture_storage");
+		f.invalidate_framebuffer = f.version >= 43 || has_extension("GL_ARB_invalidate_subdata");
+		f.vertex_attrib_binding = f.version >= 43 || has_extension("GL_ARB_vertex_attrib_binding");
+		f.compute_shader = f.version >= 43 || (
+			has_extension("GL_ARB_compute_shader") &&
+			has_extension("GL_ARB_shader_storage_buffer_object") &&
+			has_extension("GL_ARB_shader_image_load_store")
+		);
+		f.conservative_occlusion_query = f.version >= 43 || has_extension("GL_ARB_ES3_compatibility");
+		#ifdef GL_KHR_parallel_shader_compile
+		f.parallel_shader_compile = has_extension("GL_KHR_parallel_shader_compile");
+		#endif
+	}
 }
 }
@@ -0,0 +1,181 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <utility>
+
+#include "gl.hpp"
+
+namespace moggle {
+namespace gl {
+
+/// Keeps track of the bindings and other state of a GL context, to skip calls that would not change anything.
+/// \note Call invalidate() after other code changed the GL state directly.
+class state_cache {
+
+public:
+	struct statistics {
+		std::size_t issued = 0;
+		std::size_t skipped = 0;
+	};
+
+private:
+	template<typename T>
+	struct cached {
+		T value;
+		bool known = false;
+		bool is(T const & v) const { return known && value == v; }
+		void set(T const & v) { value = v; known = true; }
+	};
+
+	cached<GLuint> vertex_array_;
+	cached<GLuint> program_;
+	std::map<GLenum, cached<GLuint>> buffers_;
+	std::map<std::pair<GLenum, GLuint>, cached<GLuint>> indexed_buffers_;
+	std::map<GLenum, cached<bool>> capabilities_;
+	cached<std::array<GLint, 4>> viewport_;
+
+	statistics statistics_;
+
+	bool redundant(bool r) {
+		++(r ? statistics_.skipped : statistics_.issued);
+		return r;
+	}
+
+public:
+	void bind_buffer(GLenum target, GLuint id) {
+		auto & b = buffers_[target];
+		if (redundant(b.is(id))) return;
+		gl::bind_buffer(target, id);
+		b.set(id);
+	}
+
+	void bind_buffer_base(GLenum target, GLuint index, GLuint id) {
+		auto & b = indexed_buffers_[{target, index}];
+		if (redundant(b.is(id))) return;
+		gl::bind_buffer_base(target, index, id);
+		b.set(id);
+		buffers_[target].set(id);
+	}
+
+	void bind_buffer_range(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size) {
+		redundant(false);
+		gl::bind_buffer_range(target, index, id, offset, size);
+		indexed_buffers_[{target, index}].known = false;
+		buffers_[target].set(id);
+	}
+
+	void bind_vertex_array(GLuint id) {
+		if (redundant(vertex_array_.is(id))) return;
+		gl::bind_vertex_array(id);
+		vertex_array_.set(id);
+		// The element array buffer binding is part of the state of the vertex array object.
+		buffers_[GL_ELEMENT_ARRAY_BUFFER].known = false;
+	}
+
+	void use_program(GLuint id) {
+		if (redundant(program_.is(id))) return;
+		gl::use_program(id);
+		program_.set(id);
+	}
+
+	void enable(GLenum capability) {
+		auto & c = capabilities_[capability];
+		if (redundant(c.is(true))) return;
+		gl::enable(capability);
+		c.set(true);
+	}
+
+	void disable(GLenum capability) {
+		auto & c = capabilities_[capability];
+		if (redundant(c.is(false))) return;
+		gl::disable(capability);
+		c.set(false);
+	}
+
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		std::array<GLint, 4> v {{ x, y, width, height }};
+		if (redundant(viewport_.is(v))) return;
+		gl::viewport(x, y, width, height);
+		viewport_.set(v);
+	}
+
+	/// Should be called when a buffer is deleted, since its name can be reused.
+	void deleted_buffer(GLuint id) {
+		if (!id) return;
+		for (auto & b : buffers_) {
+			if (b.second.is(id)) b.second.set(0);
+		}
+		for (auto & b : indexed_buffers_) {
+			if (b.second.is(id)) b.second.set(0);
+		}
+	}
+
+	void deleted_vertex_array(GLuint id) {
+		if (!id) return;
+		if (vertex_array_.is(id)) {
+			vertex_array_.set(0);
+			buffers_[GL_ELEMENT_ARRAY_BUFFER].known = false;
+		}
+	}
+
+	void deleted_program(GLuint id) {
+		if (!id) return;
+		if (program_.is(id)) program_.known = false;
+	}
+
+	/// Forget all cached state. Call this after other code has made changes to the GL state.
+	void invalidate() {
+		vertex_array_.known = false;
+		program_.known = false;
+		viewport_.known = false;
+		buffers_.clear();
+		indexed_buffers_.clear();
+		capabilities_.clear();
+	}
+
+	/// The number of calls made and skipped.
+	statistics const & stats() const { return statistics_; }
+
+	void reset_stats() { statistics_ = {}; }
+
+};
+
+namespace detail {
+	inline state_cache * & current_state_cache() {
+		thread_local state_cache default_cache;
+		thread_local state_cache * current = &default_cache;
+		return current;
+	}
+}
+
+/// The state cache for the GL context that is current on this thread.
+inline state_cache & state() {
+	return *detail::current_state_cache();
+}
+
+/// When using multiple contexts on the same thread, call this after making another context current.
+inline void make_current(state_cache & s) {
+	detail::current_state_cache() = &s;
+}
+
+}
+}
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "gl.hpp"
 
 namespace moggle {
@@ -41,4 +43,67 @@ X(GLushort, GL_UNSIGNED_SHORT);
 
 #undef X
 
+/// The size in bytes of a type given by its GL constant, such as GL_FLOAT.
+inline std::size_t gl_type_size(GLenum type) {
+	switch (type) {
+		case GL_DOUBLE:
+			return 8;
+		case GL_FLOAT:
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+			return 4;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			return 2;
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		default:
+			throw gl_error{"gl_type_size", "Unknown type."};
+	}
+}
+
+/// The number of bytes of one (tightly packed) pixel with the given format and type, as used by glTexSubImage2D and glReadPixels.
+inline std::size_t gl_pixel_size(GLenum format, GLenum type) {
+	switch (type) {
+		case GL_UNSIGNED_BYTE_3_3_2:
+		case GL_UNSIGNED_BYTE_2_3_3_REV:
+			return 1;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			return 2;
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_24_8:
+		case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		case GL_UNSIGNED_INT_5_9_9_9_REV:
+			return 4;
+		case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+			return 8;
+	}
+	std::size_t components;
+	switch (format) {
+		case GL_RED: case GL_GREEN: case GL_BLUE:
+		case GL_RED_INTEGER: case GL_GREEN_INTEGER: case GL_BLUE_INTEGER:
+		case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX:
+			components = 1; break;
+		case GL_RG: case GL_RG_INTEGER:
+			components = 2; break;
+		case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER:
+			components = 3; break;
+		case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: case GL_BGRA_INTEGER:
+			components = 4; break;
+		default:
+			throw gl_error{"gl_pixel_size", "Unknown format."};
+	}
+	return components * gl_type_size(type);
+}
+
 }
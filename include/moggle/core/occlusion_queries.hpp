@@ -0,0 +1,130 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "query.hpp"
+
+namespace moggle {
+
+/// Occlusion queries for many objects, whose results are only read once available, so they never wait for the GPU.
+/// \note visible() gives the latest available result, usually of a frame or two ago. Untested objects count as visible.
+class occlusion_queries {
+
+private:
+	struct object {
+		std::deque<query> pending; // Oldest first.
+		query completed; // The latest query with an available result.
+		std::vector<query> spare;
+		bool visible = true;
+	};
+
+	GLenum target_;
+	std::unordered_map<std::size_t, object> objects_;
+
+	// Takes the results of the pending queries that are available, and keeps their queries for reuse.
+	static void collect(object & o) {
+		while (!o.pending.empty() && o.pending.front().available()) {
+			o.visible = o.pending.front().result() != 0;
+			if (o.completed) o.spare.push_back(std::move(o.completed));
+			o.completed = std::move(o.pending.front());
+			o.pending.pop_front();
+		}
+	}
+
+public:
+	/// \param target GL_ANY_SAMPLES_PASSED, or GL_ANY_SAMPLES_PASSED_CONSERVATIVE which can be faster
+	/// but may report objects as visible while they are not. The conservative variant falls back to
+	/// GL_ANY_SAMPLES_PASSED without gl::features().conservative_occlusion_query.
+	explicit occlusion_queries(GLenum target = GL_ANY_SAMPLES_PASSED) : target_(target) {
+		if (target_ == GL_ANY_SAMPLES_PASSED_CONSERVATIVE && !gl::features().conservative_occlusion_query) {
+			target_ = GL_ANY_SAMPLES_PASSED;
+		}
+	}
+
+	GLenum target() const { return target_; }
+
+	/// Starts the query for an object. Only one query can be active at a time.
+	void begin(std::size_t id) {
+		auto & o = objects_[id];
+		collect(o);
+		query q;
+		if (!o.spare.empty()) {
+			q = std::move(o.spare.back());
+			o.spare.pop_back();
+		}
+		q.begin(target_);
+		o.pending.push_back(std::move(q));
+	}
+
+	void end() {
+		query::end(target_);
+	}
+
+	/// Whether any samples passed for the object, according to the latest available result.
+	/// \note This never waits for the GPU.
+	bool visible(std::size_t id) {
+		auto i = objects_.find(id);
+		if (i == objects_.end()) return true;
+		collect(i->second);
+		return i->second.visible;
+	}
+
+	/// The latest query of the object, whether its result is available or not.
+	/// \return nullptr if the object was never tested.
+	query const * latest(std::size_t id) const {
+		auto i = objects_.find(id);
+		if (i == objects_.end()) return nullptr;
+		if (!i->second.pending.empty()) return &i->second.pending.back();
+		if (i->second.completed) return &i->second.completed;
+		return nullptr;
+	}
+
+	/// Starts conditional rendering on the latest query of the object: until end_conditional_render(),
+	/// drawing is skipped by the GPU if no samples passed.
+	/// \param mode GL_QUERY_NO_WAIT to draw anyway if the result is not yet available, or GL_QUERY_WAIT to let the GPU wait for it.
+	/// \return false, without starting conditional rendering, if the object was never tested.
+	bool begin_conditional_render(std::size_t id, GLenum mode = GL_QUERY_NO_WAIT) const {
+		query const * q = latest(id);
+		if (!q) return false;
+		gl::begin_conditional_render(q->name(), mode);
+		return true;
+	}
+
+	static void end_conditional_render() {
+		gl::end_conditional_render();
+	}
+
+	/// Forgets an object, deleting its queries.
+	void forget(std::size_t id) {
+		objects_.erase(id);
+	}
+
+	void clear() {
+		objects_.clear();
+	}
+
+};
+
+}
@@ -0,0 +1,269 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "gl.hpp"
+#include "query.hpp"
+
+namespace moggle {
+
+namespace detail {
+	/// Writes a quoted and escaped JSON string.
+	inline void write_json_string(std::ostream & out, std::string const & s) {
+		out << '"';
+		for (char c : s) {
+			if (c == '"' || c == '\\') out << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20) out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+			else out << c;
+		}
+		out << '"';
+	}
+}
+
+/// Measures CPU and GPU time spent in named zones (see zone), between begin_frame() and end_frame().
+/// \note GPU times are read back a few frames later, when available, so profiling does not stall.
+class profiler {
+
+public:
+	struct zone_statistics {
+		std::size_t count = 0;
+		double cpu_total = 0; // In milliseconds.
+		double gpu_total = 0;
+		double cpu_min = std::numeric_limits<double>::infinity();
+		double gpu_min = std::numeric_limits<double>::infinity();
+		double cpu_max = 0;
+		double gpu_max = 0;
+		double cpu_average() const { return count ? cpu_total / count : 0; }
+		double gpu_average() const { return count ? gpu_total / count : 0; }
+	};
+
+	struct event {
+		std::string name;
+		unsigned int depth;
+		std::uint64_t frame;
+		std::int64_t cpu_begin; // In nanoseconds since the creation of the profiler.
+		std::int64_t cpu_end;
+		std::int64_t gpu_begin; // In nanoseconds, on the same clock as cpu_begin.
+		std::int64_t gpu_end;
+	};
+
+	/// A zone that ends when it goes out of scope.
+	/// \note Zones that are still open at end_frame() are ended there.
+	class zone {
+	private:
+		profiler & p;
+		std::uint64_t frame_number;
+		std::size_t index;
+	public:
+		zone(profiler & p, std::string const & name) : p(p), frame_number(p.frame_number_), index(p.begin_zone(name)) {}
+		~zone() { p.end_zone(frame_number, index); }
+		zone(zone const &) = delete;
+		zone & operator = (zone const &) = delete;
+	};
+
+private:
+	struct pending_zone {
+		std::string name;
+		unsigned int depth;
+		std::int64_t cpu_begin;
+		std::int64_t cpu_end;
+		query gpu_begin;
+		query gpu_end;
+		bool open;
+	};
+
+	struct frame {
+		std::uint64_t number = 0;
+		std::int64_t gpu_offset = 0;
+		std::vector<pending_zone> zones;
+		std::size_t used = 0;
+		std::size_t last_ended = 0; // The zone whose gpu_end was issued last. Its result is available last.
+		bool pending = false;
+	};
+
+	using clock = std::chrono::steady_clock;
+
+	clock::time_point start_ = clock::now();
+
+	std::vector<frame> frames_;
+	std::uint64_t frame_number_ = 0;
+	bool in_frame_ = false;
+	unsigned int depth_ = 0;
+
+	std::map<std::string, zone_statistics> statistics_;
+	std::vector<event> events_;
+	std::size_t max_events_;
+
+	static constexpr std::size_t no_zone = std::size_t(-1);
+
+	std::int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start_).count();
+	}
+
+	frame & current_frame() {
+		return frames_[frame_number_ % frames_.size()];
+	}
+
+	std::size_t begin_zone(std::string const & name) {
+		if (!in_frame_) return no_zone;
+		frame & f = current_frame();
+		if (f.used == f.zones.size()) f.zones.emplace_back();
+		pending_zone & z = f.zones[f.used];
+		z.name = name;
+		z.depth = depth_++;
+		z.open = true;
+		z.gpu_begin.timestamp();
+		z.cpu_begin = now();
+		return f.used++;
+	}
+
+	void end_zone(std::uint64_t frame_number, std::size_t index) {
+		// Zones of an earlier frame were already ended by end_frame().
+		if (index == no_zone || !in_frame_ || frame_number != frame_number_) return;
+		frame & f = current_frame();
+		pending_zone & z = f.zones[index];
+		if (!z.open) return;
+		z.cpu_end = now();
+		z.gpu_end.timestamp();
+		z.open = false;
+		f.last_ended = index;
+		--depth_;
+	}
+
+	static double milliseconds(std::int64_t ns) { return ns / 1e6; }
+
+	void collect(frame & f) {
+		for (std::size_t i = 0; i < f.used; ++i) {
+			pending_zone const & z = f.zones[i];
+			event e {
+				z.name,
+				z.depth,
+				f.number,
+				z.cpu_begin,
+				z.cpu_end,
+				std::int64_t(z.gpu_begin.result()) + f.gpu_offset,
+				std::int64_t(z.gpu_end.result()) + f.gpu_offset
+			};
+			zone_statistics & s = statistics_[e.name];
+			double cpu = milliseconds(e.cpu_end - e.cpu_begin);
+			double gpu = milliseconds(e.gpu_end - e.gpu_begin);
+			++s.count;
+			s.cpu_total += cpu;
+			s.gpu_total += gpu;
+			s.cpu_min = std::min(s.cpu_min, cpu);
+			s.gpu_min = std::min(s.gpu_min, gpu);
+			s.cpu_max = std::max(s.cpu_max, cpu);
+			s.gpu_max = std::max(s.gpu_max, gpu);
+			if (events_.size() < max_events_) events_.push_back(std::move(e));
+		}
+		f.pending = false;
+	}
+
+	static bool ready(frame const & f) {
+		return !f.used || f.zones[f.last_ended].gpu_end.available();
+	}
+
+public:
+	/// \param frames_in_flight The number of frames to keep queries for before reading them back.
+	/// \param max_events The maximum number of events to keep for write_chrome_trace().
+	explicit profiler(std::size_t frames_in_flight = 3, std::size_t max_events = 100000)
+		: frames_(std::max<std::size_t>(frames_in_flight, 1)), max_events_(max_events) {}
+
+	profiler(profiler const &) = delete;
+	profiler & operator = (profiler const &) = delete;
+
+	void begin_frame() {
+		frame & f = current_frame();
+		// Only waits if the GPU is more than frames_in_flight frames behind.
+		if (f.pending) collect(f);
+		f.number = frame_number_;
+		f.used = 0;
+		GLint64 gpu_now;
+		gl::get_integer_64v(GL_TIMESTAMP, &gpu_now);
+		f.gpu_offset = now() - gpu_now;
+		in_frame_ = true;
+		depth_ = 0;
+	}
+
+	void end_frame() {
+		if (!in_frame_) return;
+		frame & current = current_frame();
+		for (std::size_t i = current.used; i-- > 0;) {
+			if (current.zones[i].open) end_zone(frame_number_, i);
+		}
+		current.pending = true;
+		in_frame_ = false;
+		++frame_number_;
+		for (auto & f : frames_) {
+			if (f.pending && ready(f)) collect(f);
+		}
+	}
+
+	/// Reads back all outstanding results, waiting for the GPU if necessary.
+	void flush() {
+		for (std::uint64_t n = frame_number_ - std::min<std::uint64_t>(frame_number_, frames_.size()); n < frame_number_; ++n) {
+			frame & f = frames_[n % frames_.size()];
+			if (f.pending) collect(f);
+		}
+	}
+
+	void clear() {
+		statistics_.clear();
+		events_.clear();
+	}
+
+	/// Per zone name, the statistics of all zones that have been read back.
+	std::map<std::string, zone_statistics> const & statistics() const { return statistics_; }
+
+	std::vector<event> const & events() const { return events_; }
+
+	/// Writes the events in the Chrome trace event format (chrome://tracing, Perfetto).
+	/// CPU zones are written to thread 1, GPU zones to thread 2.
+	void write_chrome_trace(std::ostream & out) const {
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+		auto write_event = [&] (event const & e, int tid, std::int64_t begin, std::int64_t end) {
+			out << ",\n{\"name\":";
+			detail::write_json_string(out, e.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid;
+			out << ",\"ts\":" << begin / 1e3 << ",\"dur\":" << (end - begin) / 1e3;
+			out << ",\"args\":{\"frame\":" << e.frame << "}}";
+		};
+		auto precision = out.precision(15);
+		for (auto const & e : events_) {
+			write_event(e, 1, e.cpu_begin, e.cpu_end);
+			write_event(e, 2, e.gpu_begin, e.gpu_end);
+		}
+		out.precision(precision);
+		out << "\n]}\n";
+	}
+
+};
+
+}
@@ -0,0 +1,140 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "gl.hpp"
+#include "shader.hpp"
+
+namespace moggle {
+
+/// A cache of linked program binaries in a directory (which must exist), to skip compiling and linking on the next run.
+/// \note Without gl::features().program_binary, nothing is cached.
+class program_binary_cache {
+
+private:
+	std::string directory_;
+
+	std::string path(std::string const & key) const {
+		return directory_ + "/" + key + ".bin";
+	}
+
+public:
+	explicit program_binary_cache(std::string directory) : directory_(std::move(directory)) {}
+
+	std::string const & directory() const { return directory_; }
+
+	/// Makes a key from everything that determines the linked program, such as the sources
+	/// and the attribute locations. The driver vendor, renderer and version are added automatically.
+	std::string key(std::vector<std::string> const & parts) const {
+		std::uint64_t h = detail::hash("", 0);
+		auto add = [&] (char const * s, std::size_t size) {
+			std::uint64_t n = size;
+			h = detail::hash(reinterpret_cast<char const *>(&n), sizeof(n), h);
+			h = detail::hash(s, size, h);
+		};
+		for (GLenum e : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+			char const * s = reinterpret_cast<char const *>(gl::get_string(e));
+			add(s, s ? std::strlen(s) : 0);
+		}
+		for (auto const & p : parts) add(p.data(), p.size());
+		char hex[17];
+		std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+		return hex;
+	}
+
+	std::string key(std::initializer_list<std::string> parts) const {
+		return key(std::vector<std::string>(parts));
+	}
+
+	/// Loads the program from the cache.
+	/// \return false if it is not in the cache, or was rejected by the driver.
+	bool load(shader_program & p, std::string const & key) const {
+		if (!gl::features().program_binary) return false;
+		std::ifstream f(path(key), std::ios::binary);
+		if (!f) return false;
+		std::uint32_t format;
+		std::uint64_t size;
+		f.read(reinterpret_cast<char *>(&format), sizeof(format));
+		f.read(reinterpret_cast<char *>(&size), sizeof(size));
+		// The size comes from a file that might be corrupt or truncated, so check it before allocating.
+		std::streamoff start = f.tellg();
+		f.seekg(0, std::ios::end);
+		std::streamoff remaining = f.tellg() - start;
+		f.seekg(start);
+		bool valid = f && start >= 0 && size > 0 && size <= std::uint64_t(remaining);
+		std::vector<char> binary(valid ? size : 0);
+		f.read(binary.data(), binary.size());
+		if (valid && f && p.load_binary(format, binary.data(), binary.size())) return true;
+		f.close();
+		std::remove(path(key).c_str());
+		return false;
+	}
+
+	/// Stores the (linked) program in the cache.
+	/// \note The program should be linked after calling shader_program::binary_retrievable().
+	void store(shader_program const & p, std::string const & key) const {
+		if (!gl::features().program_binary) return;
+		GLenum format;
+		std::vector<char> binary = p.binary(format);
+		if (binary.empty()) return;
+		// Write to a temporary file first, so a partially written file is never loaded.
+		std::string temporary = path(key) + ".tmp";
+		{
+			std::ofstream f(temporary, std::ios::binary);
+			std::uint32_t f32 = format;
+			std::uint64_t size = binary.size();
+			f.write(reinterpret_cast<char const *>(&f32), sizeof(f32));
+			f.write(reinterpret_cast<char const *>(&size), sizeof(size));
+			f.write(binary.data(), binary.size());
+			if (!f) {
+				f.close();
+				std::remove(temporary.c_str());
+				return;
+			}
+		}
+		std::remove(path(key).c_str());
+		std::rename(temporary.c_str(), path(key).c_str());
+	}
+
+	/// Loads the program from the cache if possible.
+	/// Otherwise, build(p) is called to attach the shaders (and bind attributes, etc.),
+	/// after which the program is linked and stored in the cache.
+	/// \return true if the program was loaded from the cache.
+	template<typename F>
+	bool link(shader_program & p, std::string const & key, F && build) const {
+		p.clear();
+		if (load(p, key)) return true;
+		p.clear();
+		build(p);
+		if (gl::features().program_binary) p.binary_retrievable();
+		p.link();
+		store(p, key);
+		return false;
+	}
+
+};
+
+}
@@ -0,0 +1,83 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <utility>
+
+#include "gl.hpp"
+
+namespace moggle {
+
+class query {
+
+private:
+	mutable GLuint id = 0;
+
+public:
+	explicit query(bool create_now = false) {
+		if (create_now) create();
+	}
+
+	~query() { destroy(); }
+
+	query(query const &) = delete;
+	query & operator = (query const &) = delete;
+
+	query(query && q) : id(q.id) { q.id = 0; }
+	query & operator = (query && q) { std::swap(id, q.id); return *this; }
+
+	bool created() const { return id; }
+	explicit operator bool() const { return created(); }
+
+	void create() const { if (!id) gl::generate_queries(1, &id); }
+	void destroy() { gl::delete_queries(1, &id); id = 0; }
+
+	GLuint name() const { return id; }
+
+	void begin(GLenum target) const {
+		create();
+		gl::begin_query(target, id);
+	}
+
+	static void end(GLenum target) {
+		gl::end_query(target);
+	}
+
+	/// Records the GPU time at which all previous commands have been completed.
+	void timestamp() const {
+		create();
+		gl::query_counter(id, GL_TIMESTAMP);
+	}
+
+	/// Whether result() can be called without waiting for the GPU.
+	bool available() const {
+		GLint a;
+		gl::get_query_object_iv(id, GL_QUERY_RESULT_AVAILABLE, &a);
+		return a != GL_FALSE;
+	}
+
+	/// \note This waits for the GPU if the result is not yet available().
+	GLuint64 result() const {
+		GLuint64 r;
+		gl::get_query_object_ui64v(id, GL_QUERY_RESULT, &r);
+		return r;
+	}
+
+};
+
+}
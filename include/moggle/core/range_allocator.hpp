@@ -0,0 +1,109 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <map>
+
+namespace moggle {
+
+/// Hands out ranges of [0, capacity), for suballocating a large buffer.
+///
+/// The free ranges are kept in a list ordered by offset, and adjacent free ranges
+/// are merged when a range is freed. Allocation takes the first free range that fits.
+class range_allocator {
+
+private:
+	std::map<std::size_t, std::size_t> free_; // Offset -> size.
+	std::size_t capacity_ = 0;
+	std::size_t used_ = 0;
+
+public:
+	static constexpr std::size_t none = std::size_t(-1);
+
+	explicit range_allocator(std::size_t capacity = 0) { grow(capacity); }
+
+	std::size_t capacity() const { return capacity_; }
+
+	/// The total size of the allocated ranges.
+	std::size_t used() const { return used_; }
+
+	/// The number of free ranges. Many free ranges means the free space is fragmented.
+	std::size_t free_ranges() const { return free_.size(); }
+
+	/// The size of the largest range that can be allocated.
+	std::size_t largest_free_range() const {
+		std::size_t largest = 0;
+		for (auto const & f : free_) if (f.second > largest) largest = f.second;
+		return largest;
+	}
+
+	/// \return The offset of the allocated range, or none if there is no free range large enough.
+	std::size_t allocate(std::size_t size) {
+		if (!size) return 0;
+		for (auto i = free_.begin(); i != free_.end(); ++i) {
+			if (i->second < size) continue;
+			std::size_t offset = i->first;
+			std::size_t rest = i->second - size;
+			free_.erase(i);
+			if (rest) free_[offset + size] = rest;
+			used_ += size;
+			return offset;
+		}
+		return none;
+	}
+
+	/// Frees a range previously returned by allocate(), with the same size.
+	void free(std::size_t offset, std::size_t size) {
+		if (!size) return;
+		used_ -= size;
+		auto next = free_.lower_bound(offset);
+		if (next != free_.end() && offset + size == next->first) {
+			size += next->second;
+			next = free_.erase(next);
+		}
+		if (next != free_.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+		free_[offset] = size;
+	}
+
+	/// Increases the capacity, adding the new space at the end as free space.
+	void grow(std::size_t capacity) {
+		if (capacity <= capacity_) return;
+		std::size_t old = capacity_;
+		capacity_ = capacity;
+		used_ += capacity - old;
+		free(old, capacity - old);
+	}
+
+	/// Frees everything.
+	void clear() {
+		free_.clear();
+		used_ = 0;
+		if (capacity_) free_[0] = capacity_;
+	}
+
+};
+
+}
@@ -0,0 +1,111 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "gl_state.hpp"
+#include "gl_type_traits.hpp"
+#include "fence.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// A copy of data on the GPU, which becomes available on the CPU later, without waiting for the GPU.
+///
+/// start() (or start_pixels()) copies the data into a staging buffer on the GPU and inserts a fence.
+/// Once ready(), read() copies it into client memory without stalling.
+/// To read back every frame, use one readback per frame in flight.
+class readback {
+
+private:
+	generic_vbo staging_;
+	fence fence_;
+	bool started_ = false;
+
+	void prepare_staging(std::size_t bytes) {
+		if (bytes > staging_.capacity_in_bytes()) staging_.allocate(bytes, nullptr, GL_STREAM_READ);
+		else staging_.resize_bytes(bytes);
+	}
+
+public:
+	readback() {}
+
+	readback(readback &&) = default;
+	readback & operator = (readback &&) = default;
+
+	/// Starts copying a part of a buffer.
+	void start(generic_vbo const & from, std::size_t offset, std::size_t bytes) {
+		prepare_staging(bytes);
+		staging_.copy(from, offset, 0, bytes);
+		fence_.insert();
+		gl::flush(); // Otherwise ready() may never become true, since it does not flush.
+		started_ = true;
+	}
+
+	/// Starts reading pixels from the framebuffer bound to GL_READ_FRAMEBUFFER, with glReadPixels.
+	/// The rows are tightly packed.
+	void start_pixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type) {
+		prepare_staging(width * height * gl_pixel_size(format, type));
+		staging_.bind(GL_PIXEL_PACK_BUFFER);
+		gl::pixel_store_i(GL_PACK_ALIGNMENT, 1);
+		gl::read_pixels(x, y, width, height, format, type, nullptr);
+		gl::pixel_store_i(GL_PACK_ALIGNMENT, 4);
+		gl::state().bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence_.insert();
+		gl::flush();
+		started_ = true;
+	}
+
+	/// Whether start() was called, and the data was not yet read().
+	bool started() const { return started_; }
+
+	/// Whether read() can be called without waiting.
+	bool ready() const { return started_ && fence_.signaled(); }
+
+	/// The number of bytes being read back.
+	std::size_t size_in_bytes() const { return staging_.size_in_bytes(); }
+
+	/// Copies the data into client memory, waiting for the GPU if it is not ready yet.
+	/// \param data Must have room for size_in_bytes() bytes.
+	void read(void * data) {
+		fence_.wait();
+		fence_.clear();
+		staging_.read(0, staging_.size_in_bytes(), data);
+		started_ = false;
+	}
+
+	template<typename T>
+	std::vector<T> read() {
+		std::vector<T> v((size_in_bytes() + sizeof(T) - 1) / sizeof(T));
+		read(v.data());
+		return v;
+	}
+
+	/// If the data is ready, copies it into client memory and returns true. Does not wait.
+	bool try_read(void * data) {
+		if (!ready()) return false;
+		read(data);
+		return true;
+	}
+
+};
+
+}
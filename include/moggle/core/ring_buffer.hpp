@@ -0,0 +1,139 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "gl.hpp"
+#include "fence.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// A part of a ring_buffer, handed out by ring_buffer::allocate().
+/// It is only valid until the end of the frame in which it was allocated.
+template<typename T>
+struct ring_allocation {
+	T * data;
+	std::size_t size; // In elements.
+	std::size_t offset; // In bytes, from the start of vbo.
+	generic_vbo const * vbo;
+
+	T * begin() const { return data; }
+	T * end() const { return data + size; }
+	T & operator [] (std::size_t i) const { return data[i]; }
+
+	std::size_t size_in_bytes() const { return size * sizeof(T); }
+
+	/// The offset as a pointer, as used by vao::attribute() and gl::draw_elements().
+	void const * pointer() const { return reinterpret_cast<void const *>(offset); }
+
+	/// Binds this range to an indexed target, such as GL_UNIFORM_BUFFER.
+	void bind_range(GLenum target, GLuint index) const {
+		vbo->bind_range(target, index, offset, size_in_bytes());
+	}
+};
+
+/// A buffer for data that changes every frame, with a region per frame in flight, guarded by fences.
+/// \note Persistently mapped with buffer_storage, otherwise uploaded from a client copy by flush().
+class ring_buffer {
+
+private:
+	generic_vbo vbo_;
+	char * mapping_ = nullptr;
+	std::vector<char> copy_;
+	std::vector<fence> fences_;
+	std::size_t region_size_;
+	std::size_t region_ = 0;
+	std::size_t head_ = 0;
+	std::size_t flushed_ = 0;
+
+	std::size_t region_begin() const { return region_ * region_size_; }
+
+public:
+	/// \param region_size The number of bytes that can be allocated per frame.
+	/// \param regions The number of frames in flight.
+	explicit ring_buffer(std::size_t region_size, std::size_t regions = 3)
+		: fences_(regions), region_size_(region_size) {
+		std::size_t size = region_size * regions;
+		if (gl::features().buffer_storage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			vbo_.storage(size, nullptr, flags);
+			mapping_ = static_cast<char *>(vbo_.map_bytes(0, size, flags));
+		} else {
+			vbo_.allocate(size, nullptr, GL_STREAM_DRAW);
+			copy_.resize(size);
+		}
+	}
+
+	~ring_buffer() {
+		if (mapping_) vbo_.unmap();
+	}
+
+	ring_buffer(ring_buffer const &) = delete;
+	ring_buffer & operator = (ring_buffer const &) = delete;
+
+	/// Whether the buffer is persistently mapped, in which case flush() does nothing.
+	bool persistent() const { return mapping_; }
+
+	generic_vbo const & vbo() const { return vbo_; }
+
+	std::size_t region_size() const { return region_size_; }
+
+	/// The number of bytes left in the region of this frame.
+	std::size_t available() const { return region_size_ - head_; }
+
+	/// Allocates space for count elements in the region of the current frame.
+	/// \param alignment The alignment in bytes. For uniform buffers, use GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+	template<typename T>
+	ring_allocation<T> allocate(std::size_t count, std::size_t alignment = alignof(T)) {
+		std::size_t offset = region_begin() + head_;
+		offset = (offset + alignment - 1) / alignment * alignment;
+		std::size_t end = offset + count * sizeof(T);
+		if (end > region_begin() + region_size_) throw std::length_error("ring_buffer::allocate: Out of space in this frame's region.");
+		head_ = end - region_begin();
+		char * base = mapping_ ? mapping_ : copy_.data();
+		return { reinterpret_cast<T *>(base + offset), count, offset, &vbo_ };
+	}
+
+	/// Makes everything written to the allocations so far visible to the GPU.
+	void flush() {
+		if (mapping_ || flushed_ == head_) return;
+		std::size_t offset = region_begin() + flushed_;
+		vbo_.write(offset, head_ - flushed_, copy_.data() + offset);
+		flushed_ = head_;
+	}
+
+	/// Starts a new frame. Waits if the GPU is still using this frame's region.
+	void begin_frame() {
+		fences_[region_].wait();
+		fences_[region_].clear();
+		head_ = flushed_ = 0;
+	}
+
+	void end_frame() {
+		flush();
+		fences_[region_].insert();
+		region_ = (region_ + 1) % fences_.size();
+	}
+
+};
+
+}
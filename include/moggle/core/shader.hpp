@@ -17,19 +17,27 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <fstream>
+#include <unordered_map>
 
 #include "gl.hpp"
+#include "gl_state.hpp"
+#include "vbo.hpp"
 #include "../math/matrix.hpp"
 
 namespace moggle {
 
 enum class shader_type : GLenum {
 	vertex = GL_VERTEX_SHADER,
-	fragment = GL_FRAGMENT_SHADER
+	fragment = GL_FRAGMENT_SHADER,
+	compute = GL_COMPUTE_SHADER // Requires gl::features().compute_shader.
 };
 
 class shader {
@@ -123,20 +131,105 @@ public:
 		gl::compile_shader(id);
 	}
 
+	/// Whether compiled() can be called without waiting for the compiler.
+	/// Always true without gl::features().parallel_shader_compile.
+	bool ready() const {
+		#ifdef GL_KHR_parallel_shader_compile
+		if (gl::features().parallel_shader_compile) {
+			GLint status;
+			gl::get_shader_iv(id, GL_COMPLETION_STATUS_KHR, &status);
+			return status != GL_FALSE;
+		}
+		#endif
+		return true;
+	}
+
+	/// Waits for the compilation started by try_compile() to finish, and throws if it failed.
+	void finish_compile() const {
+		if (!compiled()) throw gl_error{"gl::compile_shader", "Unable to compile shader:\n" + log()};
+	}
+
 	void compile() {
 		try_compile();
-		if (!compiled()) throw gl_error{"gl::compile_shader", "Unable to compile shader:\n" + log()};
+		finish_compile();
 	}
 
 };
 
 template<typename T> class shader_uniform_setter;
 
+/// The layout of an indirect compute dispatch, as read by shader_program::dispatch_indirect().
+struct dispatch_indirect_command {
+	GLuint num_groups_x;
+	GLuint num_groups_y;
+	GLuint num_groups_z;
+};
+
+namespace detail {
+	/// FNV-1a, a simple and fast (non-cryptographic) hash function.
+	inline std::uint64_t hash(char const * data, std::size_t size, std::uint64_t h = 14695981039346656037u) {
+		for (std::size_t i = 0; i < size; ++i) h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211u;
+		return h;
+	}
+}
+
+struct uniform_error : std::runtime_error {
+	uniform_error(std::string const & s) : std::runtime_error(s) {}
+};
+
+/// An active uniform or attribute of a linked shader_program.
+struct shader_variable {
+	std::string name;
+	GLint location;
+	GLenum type; // For example GL_FLOAT_VEC3 or GL_SAMPLER_2D.
+	GLint size; // The number of elements for arrays, 1 otherwise.
+};
+
+/// A hash table of shader_variables, that can be searched by a char const * without allocating.
+class shader_variable_table {
+
+private:
+	std::unordered_multimap<std::size_t, shader_variable> variables_;
+
+	static std::size_t hash(char const * s) {
+		return detail::hash(s, std::strlen(s));
+	}
+
+public:
+	void clear() { variables_.clear(); }
+
+	void insert(shader_variable v) {
+		std::size_t h = hash(v.name.c_str());
+		variables_.emplace(h, std::move(v));
+	}
+
+	shader_variable const * find(char const * name) const {
+		auto r = variables_.equal_range(hash(name));
+		for (auto i = r.first; i != r.second; ++i) {
+			if (i->second.name == name) return &i->second;
+		}
+		return nullptr;
+	}
+
+	std::size_t size() const { return variables_.size(); }
+	bool empty() const { return variables_.empty(); }
+
+	template<typename F>
+	void for_each(F && f) const {
+		for (auto const & v : variables_) f(v.second);
+	}
+
+};
+
 class shader_program {
 
 private:
 	GLuint id = 0;
 
+	shader_variable_table uniforms_;
+	shader_variable_table attributes_;
+	bool introspected_ = false;
+
 public:
 	explicit shader_program(bool create_now = false) {
 		if (create_now) create();
@@ -144,8 +237,19 @@ public:
 
 	~shader_program() { destroy(); }
 
-	shader_program(shader_program && s) : id(s.id) { s.id = 0; }
-	shader_program & operator = (shader_program && s) { std::swap(id, s.id); return *this; }
+	shader_program(shader_program && s)
+		: id(s.id), uniforms_(std::move(s.uniforms_)), attributes_(std::move(s.attributes_)), introspected_(s.introspected_) {
+		s.id = 0;
+		s.introspected_ = false;
+	}
+
+	shader_program & operator = (shader_program && s) {
+		std::swap(id, s.id);
+		std::swap(uniforms_, s.uniforms_);
+		std::swap(attributes_, s.attributes_);
+		std::swap(introspected_, s.introspected_);
+		return *this;
+	}
 
 	shader_program(shader_program const &) = delete;
 	shader_program & operator = (shader_program const &) = delete;
@@ -159,7 +263,11 @@ public:
 
 	void destroy() {
 		gl::delete_program(id);
+		gl::state().deleted_program(id);
 		id = 0;
+		uniforms_.clear();
+		attributes_.clear();
+		introspected_ = false;
 	}
 
 	void clear() {
@@ -190,11 +298,116 @@ public:
 		gl::link_program(id);
 	}
 
+	/// Whether linked() can be called without waiting for the compiler and linker.
+	/// Always true without gl::features().parallel_shader_compile.
+	bool ready() const {
+		#ifdef GL_KHR_parallel_shader_compile
+		if (gl::features().parallel_shader_compile) {
+			GLint status;
+			gl::get_program_iv(id, GL_COMPLETION_STATUS_KHR, &status);
+			return status != GL_FALSE;
+		}
+		#endif
+		return true;
+	}
+
+	/// Waits for the linking started by try_link() to finish, throws if it failed, and introspect()s.
+	void finish_link() {
+		if (!linked()) throw gl_error{"gl::link_program", "Unable to link program:\n" + log()};
+		introspect();
+	}
+
 	void link() {
 		try_link();
-		if (!linked()) throw gl_error{"gl::link_program", "Unable to link program:\n" + log()};
+		finish_link();
+	}
+
+	/// Makes the program capture the given outputs of the vertex shader, see transform_feedback.
+	/// \param buffer_mode GL_SEPARATE_ATTRIBS to write every output to its own buffer,
+	/// or GL_INTERLEAVED_ATTRIBS to write them all to a single buffer.
+	/// \note Must be called before linking.
+	void capture(std::vector<std::string> const & outputs, GLenum buffer_mode = GL_SEPARATE_ATTRIBS) {
+		create();
+		std::vector<char const *> names;
+		for (auto const & o : outputs) names.push_back(o.c_str());
+		gl::transform_feedback_varyings(id, names.size(), names.data(), buffer_mode);
+	}
+
+	/// Asks the driver to keep the binary of the program available for binary().
+	/// \note Must be called before linking.
+	void binary_retrievable(bool retrievable = true) {
+		create();
+		gl::program_parameter_i(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, retrievable ? GL_TRUE : GL_FALSE);
 	}
 
+	/// The binary of the linked program, as can be loaded later by load_binary().
+	/// \note Requires gl::features().program_binary.
+	std::vector<char> binary(GLenum & format) const {
+		GLint length = 0;
+		gl::get_program_iv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+		std::vector<char> b(length);
+		if (length) gl::get_program_binary(id, length, &length, &format, b.data());
+		b.resize(length);
+		return b;
+	}
+
+	/// Loads a binary as returned by binary(), instead of attaching shaders and linking.
+	/// \return false if the driver does not accept the binary (for example, after a driver update).
+	/// \note Requires gl::features().program_binary.
+	bool load_binary(GLenum format, void const * data, std::size_t size) {
+		GLint n = 0;
+		gl::get_integer_v(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+		std::vector<GLint> formats(n);
+		if (n) gl::get_integer_v(GL_PROGRAM_BINARY_FORMATS, formats.data());
+		if (std::find(formats.begin(), formats.end(), GLint(format)) == formats.end()) return false;
+		create();
+		gl::program_binary(id, format, data, size);
+		if (!linked()) return false;
+		introspect();
+		return true;
+	}
+
+	/// Looks up all active uniforms and attributes of the (linked) program.
+	/// This is done by link(), and needs to be done manually after try_link().
+	void introspect() {
+		uniforms_.clear();
+		attributes_.clear();
+		GLint count, max_length;
+		auto read = [&] (shader_variable_table & table, bool uniforms) {
+			std::string name(max_length, '\0');
+			for (GLint i = 0; i < count; ++i) {
+				GLsizei length;
+				GLint size;
+				GLenum type;
+				if (uniforms) gl::get_active_uniform(id, i, max_length, &length, &size, &type, &name[0]);
+				else gl::get_active_attribute(id, i, max_length, &length, &size, &type, &name[0]);
+				shader_variable v{ name.substr(0, length), -1, type, size };
+				v.location = uniforms ? gl::get_uniform_location(id, v.name.c_str()) : gl::get_attribute_location(id, v.name.c_str());
+				if (v.location == -1) continue; // For example, members of uniform blocks.
+				// Arrays are reported as "name[0]", but can also be found as "name".
+				if (v.name.size() > 3 && v.name.compare(v.name.size() - 3, 3, "[0]") == 0) {
+					shader_variable a = v;
+					a.name.erase(a.name.size() - 3);
+					table.insert(std::move(a));
+				}
+				table.insert(std::move(v));
+			}
+		};
+		gl::get_program_iv(id, GL_ACTIVE_UNIFORMS, &count);
+		gl::get_program_iv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+		read(uniforms_, true);
+		gl::get_program_iv(id, GL_ACTIVE_ATTRIBUTES, &count);
+		gl::get_program_iv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+		read(attributes_, false);
+		introspected_ = true;
+	}
+
+	/// The active uniforms, as found by introspect().
+	shader_variable_table const & uniforms() const { return uniforms_; }
+
+	/// The active attributes, as found by introspect().
+	shader_variable_table const & attributes() const { return attributes_; }
+
 	void bind_attribute(GLuint attribute, char const * name) {
 		gl::bind_attribute_location(id, attribute, name);
 	}
@@ -204,12 +417,95 @@ public:
 	}
 
 	void use() const {
-		gl::use_program(id);
+		gl::state().use_program(id);
+	}
+
+	/// The local work group size of the (linked) compute program, as declared in the shader by layout(local_size_x = ..) etc.
+	vector3<GLint> work_group_size() const {
+		vector3<GLint> size;
+		gl::get_program_iv(id, GL_COMPUTE_WORK_GROUP_SIZE, size.data());
+		return size;
+	}
+
+	/// Uses this (compute) program, and runs x by y by z work groups.
+	/// \note Use gl::memory_barrier() before using the results in a way that is not automatically synchronized,
+	/// such as reading from a buffer or image that the compute shader wrote to.
+	void dispatch(GLuint x, GLuint y = 1, GLuint z = 1) const {
+		use();
+		gl::dispatch_compute(x, y, z);
+	}
+
+	/// Like dispatch(), but reads the number of work groups from a buffer,
+	/// as a dispatch_indirect_command at the given offset.
+	/// This way, the number can be computed on the GPU, for example by an earlier dispatch.
+	void dispatch_indirect(generic_vbo const & commands, std::size_t offset = 0) const {
+		use();
+		commands.bind(GL_DISPATCH_INDIRECT_BUFFER);
+		gl::dispatch_compute_indirect(offset);
+	}
+
+	/// Makes the uniform block with the given name use the buffer bound to the given binding point.
+	/// (See ubo::bind().)
+	/// \return false if the program has no active uniform block with that name.
+	bool uniform_block(char const * name, GLuint binding) {
+		GLuint index = gl::get_uniform_block_index(id, name);
+		if (index == GL_INVALID_INDEX) return false;
+		gl::uniform_block_binding(id, index, binding);
+		return true;
+	}
+
+	bool uniform_block(std::string const & name, GLuint binding) {
+		return uniform_block(name.data(), binding);
 	}
 
+	/// Makes the shader storage block with the given name use the buffer bound to the given binding point.
+	/// (See vbo::bind_base() with GL_SHADER_STORAGE_BUFFER.)
+	/// \return false if the program has no active shader storage block with that name.
+	/// \note Requires gl::features().compute_shader.
+	bool storage_block(char const * name, GLuint binding) {
+		GLuint index = gl::get_program_resource_index(id, GL_SHADER_STORAGE_BLOCK, name);
+		if (index == GL_INVALID_INDEX) return false;
+		gl::shader_storage_block_binding(id, index, binding);
+		return true;
+	}
+
+	bool storage_block(std::string const & name, GLuint binding) {
+		return storage_block(name.data(), binding);
+	}
+
+	/// The size in bytes of the uniform block with the given name, or 0 if there is no such active block.
+	std::size_t uniform_block_size(char const * name) const {
+		GLuint index = gl::get_uniform_block_index(id, name);
+		if (index == GL_INVALID_INDEX) return 0;
+		GLint size;
+		gl::get_active_uniform_block_iv(id, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		return size;
+	}
+
+	/// Looks up a uniform, to set its value.
+	/// The returned setter can be kept and reused, as long as the program is not relinked.
+	/// Uniforms that are not active are silently ignored, like in GL itself.
+	/// \throws uniform_error when the type of the uniform does not match T.
 	template<typename T>
 	shader_uniform_setter<T> uniform(char const * name) const {
-		return { gl::get_uniform_location(id, name) };
+		if (!introspected_) return { id, gl::get_uniform_location(id, name), 0 };
+		shader_variable const * u = uniforms_.find(name);
+		if (u) {
+			if (!shader_uniform_setter<T>::accepts(u->type)) {
+				throw uniform_error{"Type mismatch for uniform '" + std::string(name) + "'."};
+			}
+			return { id, u->location, u->size };
+		}
+		// Elements of arrays, like "lights[2]", are not in the table, only the array itself.
+		char const * bracket = std::strrchr(name, '[');
+		if (!bracket || name[std::strlen(name) - 1] != ']') return {};
+		shader_variable const * a = uniforms_.find(std::string(name, bracket).c_str());
+		GLint element = std::atoi(bracket + 1);
+		if (!a || element < 0 || element >= a->size) return {};
+		if (!shader_uniform_setter<T>::accepts(a->type)) {
+			throw uniform_error{"Type mismatch for uniform '" + std::string(name) + "'."};
+		}
+		return { id, gl::get_uniform_location(id, name), a->size - element };
 	}
 
 	template<typename T>
@@ -219,41 +515,117 @@ public:
 
 };
 
-#define X(T,...)                                    \
-	template<> class shader_uniform_setter<T> {     \
-		GLint id;                                   \
-		shader_uniform_setter(GLint id) : id(id) {} \
-		friend class shader_program;                \
-	public:                                         \
-		void set(T const & v) {                     \
-			__VA_ARGS__;                            \
-		}                                           \
-	}
-
-X(GLfloat, gl::uniform_1f (id, v));
-X(GLint  , gl::uniform_1i (id, v));
-X(GLuint , gl::uniform_1ui(id, v));
-
-X(vector2<GLfloat>, gl::uniform_2fv (id, 1, v.data()));
-X(vector3<GLfloat>, gl::uniform_3fv (id, 1, v.data()));
-X(vector4<GLfloat>, gl::uniform_4fv (id, 1, v.data()));
-X(vector2<GLint  >, gl::uniform_2iv (id, 1, v.data()));
-X(vector3<GLint  >, gl::uniform_3iv (id, 1, v.data()));
-X(vector4<GLint  >, gl::uniform_4iv (id, 1, v.data()));
-X(vector2<GLuint >, gl::uniform_2uiv(id, 1, v.data()));
-X(vector3<GLuint >, gl::uniform_3uiv(id, 1, v.data()));
-X(vector4<GLuint >, gl::uniform_4uiv(id, 1, v.data()));
-
-X(matrix2<GLfloat>, gl::uniform_matrix_2fv(id, 1, GL_TRUE, v.data()));
-X(matrix3<GLfloat>, gl::uniform_matrix_3fv(id, 1, GL_TRUE, v.data()));
-X(matrix4<GLfloat>, gl::uniform_matrix_4fv(id, 1, GL_TRUE, v.data()));
-
-X(matrix3x2<GLfloat>, gl::uniform_matrix_2x3fv(id, 1, GL_TRUE, v.data()));
-X(matrix2x3<GLfloat>, gl::uniform_matrix_3x2fv(id, 1, GL_TRUE, v.data()));
-X(matrix4x2<GLfloat>, gl::uniform_matrix_2x4fv(id, 1, GL_TRUE, v.data()));
-X(matrix2x4<GLfloat>, gl::uniform_matrix_4x2fv(id, 1, GL_TRUE, v.data()));
-X(matrix4x3<GLfloat>, gl::uniform_matrix_3x4fv(id, 1, GL_TRUE, v.data()));
-X(matrix3x4<GLfloat>, gl::uniform_matrix_4x3fv(id, 1, GL_TRUE, v.data()));
+namespace detail {
+
+	inline bool is_numeric_uniform_type(GLenum t) {
+		switch (t) {
+			case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+			case GL_DOUBLE: case GL_DOUBLE_VEC2: case GL_DOUBLE_VEC3: case GL_DOUBLE_VEC4:
+			case GL_INT: case GL_INT_VEC2: case GL_INT_VEC3: case GL_INT_VEC4:
+			case GL_UNSIGNED_INT: case GL_UNSIGNED_INT_VEC2: case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+			case GL_BOOL: case GL_BOOL_VEC2: case GL_BOOL_VEC3: case GL_BOOL_VEC4:
+			case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+			case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT3x2:
+			case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+			case GL_DOUBLE_MAT2: case GL_DOUBLE_MAT3: case GL_DOUBLE_MAT4:
+			case GL_DOUBLE_MAT2x3: case GL_DOUBLE_MAT2x4: case GL_DOUBLE_MAT3x2:
+			case GL_DOUBLE_MAT3x4: case GL_DOUBLE_MAT4x2: case GL_DOUBLE_MAT4x3:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	/// Whether a uniform of type u can be set by the glUniform* function for type s.
+	inline bool uniform_type_accepts(GLenum s, GLenum u) {
+		if (s == u) return true;
+		switch (s) {
+			case GL_INT: return u == GL_BOOL || !is_numeric_uniform_type(u); // Samplers and images are set as GLint.
+			case GL_UNSIGNED_INT: case GL_FLOAT: return u == GL_BOOL;
+			case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_FLOAT_VEC2: return u == GL_BOOL_VEC2;
+			case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_FLOAT_VEC3: return u == GL_BOOL_VEC3;
+			case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_FLOAT_VEC4: return u == GL_BOOL_VEC4;
+			default: return false;
+		}
+	}
+
+}
+
+class shader_uniform_base {
+protected:
+	GLuint program = 0;
+	GLint id = -1;
+	GLint size = 0; // Zero if unknown.
+	shader_uniform_base() {}
+	shader_uniform_base(GLuint program, GLint id, GLint size)
+		: program(program), id(id), size(size) {}
+	void check_count(std::size_t count) const {
+		if (size && count > std::size_t(size)) throw uniform_error{"Too many values for uniform."};
+	}
+public:
+	/// Whether the uniform is active. Setting an inactive uniform does nothing.
+	bool active() const { return id != -1; }
+	GLint location() const { return id; }
+};
+
+// With gl::features().program_uniform, uniforms are set without using the program.
+// Otherwise, the program is used first (which is skipped if it already is in use).
+
+#define X(T, C, F, ...)                                              \
+	template<>                                                       \
+	class shader_uniform_setter<T> : public shader_uniform_base {    \
+		shader_uniform_setter(GLuint program, GLint id, GLint size)  \
+			: shader_uniform_base(program, id, size) {}              \
+		friend class shader_program;                                 \
+	public:                                                          \
+		shader_uniform_setter() {}                                   \
+		static bool accepts(GLenum type) {                           \
+			return detail::uniform_type_accepts(C, type);            \
+		}                                                            \
+		void set(T const * values, std::size_t count) {              \
+			if (!count) return;                                      \
+			check_count(count);                                      \
+			if (gl::features().program_uniform) {                    \
+				gl::program_##F(program, id, count, __VA_ARGS__);    \
+			} else {                                                 \
+				gl::state().use_program(program);                    \
+				gl::F(id, count, __VA_ARGS__);                       \
+			}                                                        \
+		}                                                            \
+		void set(T const & v) { set(&v, 1); }                        \
+		void set_array(std::vector<T> const & v) {                   \
+			set(v.data(), v.size());                                 \
+		}                                                            \
+		template<size_t N>                                           \
+		void set_array(std::array<T, N> const & v) {                 \
+			set(v.data(), N);                                        \
+		}                                                            \
+	}
+
+X(GLfloat, GL_FLOAT       , uniform_1fv , values);
+X(GLint  , GL_INT         , uniform_1iv , values);
+X(GLuint , GL_UNSIGNED_INT, uniform_1uiv, values);
+
+X(vector2<GLfloat>, GL_FLOAT_VEC2       , uniform_2fv , values->data());
+X(vector3<GLfloat>, GL_FLOAT_VEC3       , uniform_3fv , values->data());
+X(vector4<GLfloat>, GL_FLOAT_VEC4       , uniform_4fv , values->data());
+X(vector2<GLint  >, GL_INT_VEC2         , uniform_2iv , values->data());
+X(vector3<GLint  >, GL_INT_VEC3         , uniform_3iv , values->data());
+X(vector4<GLint  >, GL_INT_VEC4         , uniform_4iv , values->data());
+X(vector2<GLuint >, GL_UNSIGNED_INT_VEC2, uniform_2uiv, values->data());
+X(vector3<GLuint >, GL_UNSIGNED_INT_VEC3, uniform_3uiv, values->data());
+X(vector4<GLuint >, GL_UNSIGNED_INT_VEC4, uniform_4uiv, values->data());
+
+X(matrix2<GLfloat>, GL_FLOAT_MAT2, uniform_matrix_2fv, GL_TRUE, values->data());
+X(matrix3<GLfloat>, GL_FLOAT_MAT3, uniform_matrix_3fv, GL_TRUE, values->data());
+X(matrix4<GLfloat>, GL_FLOAT_MAT4, uniform_matrix_4fv, GL_TRUE, values->data());
+
+X(matrix3x2<GLfloat>, GL_FLOAT_MAT2x3, uniform_matrix_2x3fv, GL_TRUE, values->data());
+X(matrix2x3<GLfloat>, GL_FLOAT_MAT3x2, uniform_matrix_3x2fv, GL_TRUE, values->data());
+X(matrix4x2<GLfloat>, GL_FLOAT_MAT2x4, uniform_matrix_2x4fv, GL_TRUE, values->data());
+X(matrix2x4<GLfloat>, GL_FLOAT_MAT4x2, uniform_matrix_4x2fv, GL_TRUE, values->data());
+X(matrix4x3<GLfloat>, GL_FLOAT_MAT3x4, uniform_matrix_3x4fv, GL_TRUE, values->data());
+X(matrix3x4<GLfloat>, GL_FLOAT_MAT4x3, uniform_matrix_4x3fv, GL_TRUE, values->data());
 
 #undef X
 
@@ -0,0 +1,129 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "shader.hpp"
+
+namespace moggle {
+
+/// Compiles and links many programs without waiting for each of them.
+/// \note With gl::features().parallel_shader_compile, ready() and poll() tell which programs are done without blocking.
+class shader_batch {
+
+public:
+	using handle = std::size_t;
+
+private:
+	struct job {
+		std::function<bool()> ready;
+		std::function<void()> finish;
+		bool done;
+	};
+
+	std::vector<job> jobs_;
+	std::size_t remaining_ = 0;
+
+public:
+	/// Sets the number of threads the driver may use for compiling, if supported.
+	static void max_threads(GLuint count) {
+		#ifdef GL_KHR_parallel_shader_compile
+		if (gl::features().parallel_shader_compile) gl::max_shader_compiler_threads(count);
+		#else
+		(void)count;
+		#endif
+	}
+
+	/// Adds a custom job. finish() is called once ready() returns true, or when it is waited for.
+	handle add(std::function<bool()> ready, std::function<void()> finish) {
+		jobs_.push_back({ std::move(ready), std::move(finish), false });
+		++remaining_;
+		return jobs_.size() - 1;
+	}
+
+	/// Starts compiling the given sources and linking them into p.
+	/// \param before_link Called after attaching the shaders, to (for example) bind attributes.
+	handle add(
+		shader_program & p,
+		std::vector<std::pair<shader_type, std::string>> const & sources,
+		std::function<void(shader_program &)> before_link = nullptr
+	) {
+		p.clear();
+		auto shaders = std::make_shared<std::vector<shader>>();
+		for (auto const & s : sources) {
+			shaders->emplace_back(s.first);
+			shaders->back().load(s.second);
+			shaders->back().try_compile();
+			p.attach(shaders->back());
+		}
+		if (before_link) before_link(p);
+		p.try_link();
+		return add(
+			[&p] { return p.ready(); },
+			[&p, shaders] {
+				// Report compile errors before link errors, since they are more useful.
+				for (auto const & s : *shaders) s.finish_compile();
+				p.finish_link();
+			}
+		);
+	}
+
+	/// Whether the job can be finished without waiting.
+	bool ready(handle h) const {
+		return jobs_[h].done || jobs_[h].ready();
+	}
+
+	bool done(handle h) const {
+		return jobs_[h].done;
+	}
+
+	/// Finishes the job, waiting for it if necessary.
+	/// \throws gl_error if compiling or linking failed.
+	void finish(handle h) {
+		job & j = jobs_[h];
+		if (j.done) return;
+		j.done = true;
+		--remaining_;
+		j.finish();
+	}
+
+	/// Finishes all jobs that are ready, without waiting.
+	/// \return The number of jobs that are not yet finished.
+	std::size_t poll() {
+		for (handle h = 0; h < jobs_.size(); ++h) {
+			if (!jobs_[h].done && jobs_[h].ready()) finish(h);
+		}
+		return remaining_;
+	}
+
+	/// Finishes all jobs, waiting for them if necessary.
+	void wait() {
+		for (handle h = 0; h < jobs_.size(); ++h) finish(h);
+	}
+
+	std::size_t remaining() const { return remaining_; }
+
+};
+
+}
@@ -0,0 +1,131 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "gl.hpp"
+#include "block_layout.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// A shader storage buffer object holding an array of T (see layout_traits), using the std430 layout.
+/// \note Only the range of elements changed since the last sync() is uploaded. Requires gl::features().compute_shader.
+template<typename T>
+class ssbo {
+
+public:
+	using traits = layout_traits<layout_standard::std430, T>;
+
+	/// The distance in bytes between two elements.
+	static constexpr std::size_t stride = detail::align_up(traits::size, traits::alignment);
+
+private:
+	mutable generic_vbo vbo_;
+	std::vector<char> data_;
+
+	// The range of elements that changed since the last sync.
+	mutable std::size_t dirty_begin_ = 0;
+	mutable std::size_t dirty_end_ = 0;
+
+	void mark_dirty(std::size_t begin, std::size_t end) {
+		if (dirty_begin_ == dirty_end_) {
+			dirty_begin_ = begin;
+			dirty_end_ = end;
+		} else {
+			dirty_begin_ = std::min(dirty_begin_, begin);
+			dirty_end_ = std::max(dirty_end_, end);
+		}
+	}
+
+public:
+	ssbo() {}
+
+	explicit ssbo(std::size_t size) : data_(size * stride) {
+		mark_dirty();
+	}
+
+	explicit ssbo(std::vector<T> const & elements) {
+		assign(elements);
+	}
+
+	/// The number of elements.
+	std::size_t size() const { return data_.size() / stride; }
+
+	bool empty() const { return data_.empty(); }
+
+	/// Changes the number of elements. New elements are zero.
+	void resize(std::size_t size) {
+		data_.resize(size * stride);
+		mark_dirty();
+	}
+
+	void set(std::size_t i, T const & v) {
+		traits::write(&data_[i * stride], v);
+		mark_dirty(i, i + 1);
+	}
+
+	void push_back(T const & v) {
+		resize(size() + 1);
+		set(size() - 1, v);
+	}
+
+	void assign(std::vector<T> const & elements) {
+		data_.assign(elements.size() * stride, 0);
+		for (std::size_t i = 0; i < elements.size(); ++i) traits::write(&data_[i * stride], elements[i]);
+		mark_dirty();
+	}
+
+	void mark_dirty() { mark_dirty(0, size()); }
+
+	bool is_dirty() const { return dirty_begin_ != dirty_end_ || vbo_.size_in_bytes() != data_.size(); }
+
+	/// The data, laid out as it will be uploaded.
+	std::vector<char> const & data() const { return data_; }
+
+	void sync() const {
+		if (!is_dirty()) return;
+		if (vbo_.size_in_bytes() == data_.size()) {
+			vbo_.write(dirty_begin_ * stride, (dirty_end_ - dirty_begin_) * stride, &data_[dirty_begin_ * stride]);
+		} else {
+			vbo_.allocate(data_.size(), data_.data(), GL_DYNAMIC_DRAW);
+		}
+		dirty_begin_ = dirty_end_ = 0;
+	}
+
+	/// Binds the buffer to the given binding point (after uploading it, if needed).
+	/// \see shader_program::storage_block()
+	void bind(GLuint binding) const {
+		sync();
+		vbo_.bind_base(GL_SHADER_STORAGE_BUFFER, binding);
+	}
+
+	/// Binds only count elements, starting at first, to the given binding point.
+	/// \note first * stride must be a multiple of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+	void bind_range(GLuint binding, std::size_t first, std::size_t count) const {
+		sync();
+		vbo_.bind_range(GL_SHADER_STORAGE_BUFFER, binding, first * stride, count * stride);
+	}
+
+	generic_vbo const & vbo() const { return vbo_; }
+
+};
+
+}
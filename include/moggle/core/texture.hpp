@@ -0,0 +1,229 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+
+#include "gl.hpp"
+#include "gl_type_traits.hpp"
+
+namespace moggle {
+
+/// A (two-dimensional) texture, with immutable storage when available (see gl::init()).
+///
+/// Without direct state access, textures are bound to the active texture unit to edit them.
+class texture {
+
+private:
+	mutable GLuint id = 0;
+	GLenum target_;
+	GLenum internal_format_ = 0;
+	GLsizei width_ = 0;
+	GLsizei height_ = 0;
+	GLsizei levels_ = 0;
+
+	static bool dsa() { return gl::features().direct_state_access; }
+
+	void bind_to_edit() const {
+		create();
+		gl::bind_texture(target_, id);
+	}
+
+public:
+	explicit texture(GLenum target = GL_TEXTURE_2D, bool create_now = false) : target_(target) {
+		if (create_now) create();
+	}
+
+	~texture() { destroy(); }
+
+	texture(texture const &) = delete;
+	texture & operator = (texture const &) = delete;
+
+	texture(texture && t)
+		: id(t.id), target_(t.target_), internal_format_(t.internal_format_),
+		  width_(t.width_), height_(t.height_), levels_(t.levels_) {
+		t.id = 0;
+		t.width_ = t.height_ = t.levels_ = 0;
+	}
+
+	texture & operator = (texture && t) {
+		std::swap(id, t.id);
+		std::swap(target_, t.target_);
+		std::swap(internal_format_, t.internal_format_);
+		std::swap(width_, t.width_);
+		std::swap(height_, t.height_);
+		std::swap(levels_, t.levels_);
+		return *this;
+	}
+
+	bool created() const { return id; }
+	explicit operator bool() const { return created(); }
+
+	void create() const {
+		if (id) return;
+		if (dsa()) gl::create_textures(target_, 1, &id);
+		else gl::generate_textures(1, &id);
+	}
+
+	void destroy() {
+		gl::delete_textures(1, &id);
+		id = 0;
+		width_ = height_ = levels_ = 0;
+	}
+
+	GLuint name() const { return id; }
+	GLenum target() const { return target_; }
+	GLenum internal_format() const { return internal_format_; }
+	GLsizei width() const { return width_; }
+	GLsizei height() const { return height_; }
+	GLsizei levels() const { return levels_; }
+
+	/// The number of levels of a full mipmap chain for the given size.
+	static GLsizei full_levels(GLsizei width, GLsizei height) {
+		GLsizei levels = 1;
+		for (GLsizei s = std::max(width, height); s > 1; s /= 2) ++levels;
+		return levels;
+	}
+
+	/// Allocates storage for all levels, without filling it.
+	/// \param levels The number of mipmap levels, or 0 for a full mipmap chain.
+	/// \note Immutable storage can not be reallocated, so if this texture already had storage,
+	/// it is replaced by a new texture object.
+	void storage(GLenum internal_format, GLsizei width, GLsizei height, GLsizei levels = 0) {
+		if (!levels) levels = full_levels(width, height);
+		if (levels_ && gl::features().texture_storage) destroy();
+		if (dsa()) {
+			create();
+			gl::named_texture_storage_2d(id, levels, internal_format, width, height);
+		} else if (gl::features().texture_storage) {
+			bind_to_edit();
+			gl::texture_storage_2d(target_, levels, internal_format, width, height);
+		} else {
+			// Emulated with mutable storage. The format and type don't matter,
+			// except that they have to be compatible with the internal format.
+			GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+			if (internal_format == GL_DEPTH24_STENCIL8 || internal_format == GL_DEPTH32F_STENCIL8) {
+				format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8;
+			} else if (internal_format == GL_DEPTH_COMPONENT16 || internal_format == GL_DEPTH_COMPONENT24 || internal_format == GL_DEPTH_COMPONENT32F) {
+				format = GL_DEPTH_COMPONENT; type = GL_FLOAT;
+			} else {
+				switch (internal_format) {
+					case GL_R8I: case GL_R8UI: case GL_R16I: case GL_R16UI: case GL_R32I: case GL_R32UI:
+						format = GL_RED_INTEGER; break;
+					case GL_RG8I: case GL_RG8UI: case GL_RG16I: case GL_RG16UI: case GL_RG32I: case GL_RG32UI:
+						format = GL_RG_INTEGER; break;
+					case GL_RGB8I: case GL_RGB8UI: case GL_RGB16I: case GL_RGB16UI: case GL_RGB32I: case GL_RGB32UI:
+						format = GL_RGB_INTEGER; break;
+					case GL_RGBA8I: case GL_RGBA8UI: case GL_RGBA16I: case GL_RGBA16UI: case GL_RGBA32I: case GL_RGBA32UI: case GL_RGB10_A2UI:
+						format = GL_RGBA_INTEGER; break;
+				}
+			}
+			bind_to_edit();
+			for (GLsizei l = 0; l < levels; ++l) {
+				GLsizei w = std::max(1, width >> l), h = std::max(1, height >> l);
+				gl::texture_image_2d(target_, l, internal_format, w, h, 0, format, type, nullptr);
+			}
+			gl::texture_parameter_i(target_, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		}
+		internal_format_ = internal_format;
+		width_ = width;
+		height_ = height;
+		levels_ = levels;
+	}
+
+	/// Uploads a rectangle of pixels to the given level.
+	/// \param pixels The pixel data, or an offset into the buffer bound to GL_PIXEL_UNPACK_BUFFER.
+	void image(GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void const * pixels) {
+		if (dsa()) {
+			gl::named_texture_sub_image_2d(id, level, x, y, width, height, format, type, pixels);
+		} else {
+			bind_to_edit();
+			gl::texture_sub_image_2d(target_, level, x, y, width, height, format, type, pixels);
+		}
+	}
+
+	/// Uploads the whole first level.
+	void image(GLenum format, GLenum type, void const * pixels) {
+		image(0, 0, 0, width_, height_, format, type, pixels);
+	}
+
+	/// Generates all other levels from the first level.
+	void generate_mipmaps() {
+		if (dsa()) {
+			gl::generate_named_texture_mipmap(id);
+		} else {
+			bind_to_edit();
+			gl::generate_mipmap(target_);
+		}
+	}
+
+	void parameter(GLenum name, GLint value) {
+		if (dsa()) {
+			create();
+			gl::named_texture_parameter_i(id, name, value);
+		} else {
+			bind_to_edit();
+			gl::texture_parameter_i(target_, name, value);
+		}
+	}
+
+	void parameter(GLenum name, GLfloat value) {
+		if (dsa()) {
+			create();
+			gl::named_texture_parameter_f(id, name, value);
+		} else {
+			bind_to_edit();
+			gl::texture_parameter_f(target_, name, value);
+		}
+	}
+
+	void filter(GLint min, GLint mag) {
+		parameter(GL_TEXTURE_MIN_FILTER, min);
+		parameter(GL_TEXTURE_MAG_FILTER, mag);
+	}
+
+	void wrap(GLint s, GLint t) {
+		parameter(GL_TEXTURE_WRAP_S, s);
+		parameter(GL_TEXTURE_WRAP_T, t);
+	}
+
+	/// Binds the texture to the given texture unit.
+	/// \note Without direct state access, this leaves the given unit active.
+	void bind(GLuint unit) const {
+		create();
+		if (dsa()) {
+			gl::bind_texture_unit(unit, id);
+		} else {
+			gl::active_texture(GL_TEXTURE0 + unit);
+			gl::bind_texture(target_, id);
+		}
+	}
+
+	/// Binds a level of the texture to the given image unit, for image load/store in shaders.
+	/// \param access GL_READ_ONLY, GL_WRITE_ONLY or GL_READ_WRITE.
+	/// \param format The format the shader sees, for example GL_RGBA8 or GL_R32F.
+	/// \note Requires gl::features().compute_shader.
+	void bind_image(GLuint unit, GLenum access, GLenum format, GLint level = 0) const {
+		create();
+		gl::bind_image_texture(unit, id, level, GL_FALSE, 0, access, format);
+	}
+
+};
+
+}
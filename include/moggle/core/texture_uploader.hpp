@@ -0,0 +1,131 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "gl.hpp"
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+#include "texture.hpp"
+
+namespace moggle {
+
+/// Streams pixels into textures through a ring of pixel unpack buffers, at most a fixed number of bytes per update().
+class texture_uploader {
+
+private:
+	struct job {
+		texture * target;
+		GLint level, x, y;
+		GLsizei width, height;
+		GLenum format, type;
+		std::vector<unsigned char> pixels; // Tightly packed rows.
+		GLsizei rows_done;
+		std::function<void()> done;
+	};
+
+	ring_buffer ring_;
+	std::deque<job> jobs_;
+
+	// The offset in a pixel unpack buffer has to be aligned to the size of the type.
+	static constexpr std::size_t alignment = 16;
+
+public:
+	/// \param bytes_per_frame The maximum number of bytes uploaded by a single update().
+	/// \param frames The number of frames the GPU may lag behind.
+	explicit texture_uploader(std::size_t bytes_per_frame, std::size_t frames = 3)
+		: ring_(bytes_per_frame + alignment, frames) {}
+
+	/// Queues an upload of a rectangle of pixels to a level of the texture, which must already have storage.
+	/// \param done Called when the last part has been uploaded, e.g. to generate the mipmaps.
+	/// \note The texture must outlive the upload, or be cancel()ed.
+	void upload(
+		texture & t,
+		GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+		GLenum format, GLenum type,
+		std::vector<unsigned char> pixels,
+		std::function<void()> done = nullptr
+	) {
+		std::size_t row = width * gl_pixel_size(format, type);
+		if (pixels.size() < row * height) throw std::length_error("texture_uploader::upload: Not enough pixels.");
+		if (row > ring_.region_size() - alignment) throw std::length_error("texture_uploader::upload: A row does not fit in a frame.");
+		jobs_.push_back({&t, level, x, y, width, height, format, type, std::move(pixels), 0, std::move(done)});
+	}
+
+	/// Queues an upload of the whole first level of the texture.
+	void upload(texture & t, GLenum format, GLenum type, std::vector<unsigned char> pixels, std::function<void()> done = nullptr) {
+		upload(t, 0, 0, 0, t.width(), t.height(), format, type, std::move(pixels), std::move(done));
+	}
+
+	/// Removes all queued uploads to the given texture.
+	void cancel(texture const & t) {
+		jobs_.erase(
+			std::remove_if(jobs_.begin(), jobs_.end(), [&] (job const & j) { return j.target == &t; }),
+			jobs_.end()
+		);
+	}
+
+	/// The number of uploads that are not yet finished.
+	std::size_t pending() const { return jobs_.size(); }
+
+	bool idle() const { return jobs_.empty(); }
+
+	/// Uploads the next part of the queue. Call this once per frame.
+	/// Waits only if the GPU is more frames behind than given to the constructor.
+	void update() {
+		if (jobs_.empty()) return;
+		std::vector<std::function<void()>> finished;
+		ring_.begin_frame();
+		ring_.vbo().bind(GL_PIXEL_UNPACK_BUFFER);
+		gl::pixel_store_i(GL_UNPACK_ALIGNMENT, 1);
+		while (!jobs_.empty()) {
+			job & j = jobs_.front();
+			std::size_t row = j.width * gl_pixel_size(j.format, j.type);
+			std::size_t available = ring_.available() > alignment ? ring_.available() - alignment : 0;
+			GLsizei rows = GLsizei(std::min<std::size_t>(j.height - j.rows_done, available / row));
+			if (!rows) break;
+			auto a = ring_.allocate<unsigned char>(rows * row, alignment);
+			std::memcpy(a.data, j.pixels.data() + j.rows_done * row, rows * row);
+			ring_.flush();
+			j.target->image(j.level, j.x, j.y + j.rows_done, j.width, rows, j.format, j.type, a.pointer());
+			j.rows_done += rows;
+			if (j.rows_done == j.height) {
+				if (j.done) finished.push_back(std::move(j.done));
+				jobs_.pop_front();
+			}
+		}
+		gl::pixel_store_i(GL_UNPACK_ALIGNMENT, 4);
+		gl::state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring_.end_frame();
+		for (auto & f : finished) f();
+	}
+
+	/// Uploads everything that is queued, waiting for the GPU when needed.
+	void finish() {
+		while (!jobs_.empty()) update();
+	}
+
+};
+
+}
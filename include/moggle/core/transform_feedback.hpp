@@ -0,0 +1,71 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include "gl.hpp"
+#include "gl_state.hpp"
+#include "query.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// Captures outputs of the vertex shader (see shader_program::capture()) into buffers, while drawing between begin() and end().
+class transform_feedback {
+
+private:
+	query primitives_;
+	bool active_ = false;
+	bool discard_ = false; // Whether begin() enabled GL_RASTERIZER_DISCARD, so end() disables it again.
+
+public:
+	bool active() const { return active_; }
+
+	/// Starts capturing.
+	/// \param primitive_mode GL_POINTS, GL_LINES or GL_TRIANGLES, matching what is drawn.
+	/// \param outputs One buffer per output with GL_SEPARATE_ATTRIBS, or a single buffer with GL_INTERLEAVED_ATTRIBS.
+	/// The buffers must be large enough for everything that is captured.
+	/// \param discard Whether to skip rasterization, when only the captured outputs are needed.
+	void begin(GLenum primitive_mode, std::vector<generic_vbo const *> const & outputs, bool discard = true) {
+		for (std::size_t i = 0; i < outputs.size(); ++i) outputs[i]->bind_base(GL_TRANSFORM_FEEDBACK_BUFFER, i);
+		discard_ = discard && !gl::is_enabled(GL_RASTERIZER_DISCARD);
+		if (discard_) gl::state().enable(GL_RASTERIZER_DISCARD);
+		primitives_.begin(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		gl::begin_transform_feedback(primitive_mode);
+		active_ = true;
+	}
+
+	void end() {
+		if (!active_) return;
+		gl::end_transform_feedback();
+		query::end(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		if (discard_) gl::state().disable(GL_RASTERIZER_DISCARD);
+		active_ = false;
+	}
+
+	/// Whether primitives_written() can be called without waiting for the GPU.
+	bool primitives_written_available() const { return primitives_.available(); }
+
+	/// The number of primitives written by the last capture.
+	/// \note This waits for the GPU if the result is not yet available.
+	GLuint64 primitives_written() const { return primitives_.result(); }
+
+};
+
+}
@@ -0,0 +1,91 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#include "gl.hpp"
+#include "block_layout.hpp"
+#include "vbo.hpp"
+
+namespace moggle {
+
+/// A uniform buffer object holding one uniform block with the given members, using the std140 layout.
+/// \note Changes are kept in client memory, and uploaded by the next bind().
+template<typename... Members>
+class ubo {
+
+public:
+	using layout = block_layout<layout_standard::std140, Members...>;
+
+	template<std::size_t I>
+	using member_type = typename layout::template member_type<I>;
+
+private:
+	mutable generic_vbo vbo_;
+	std::vector<char> data_;
+	mutable bool dirty_ = true;
+
+public:
+	ubo() : data_(layout::padded_size) {}
+
+	explicit ubo(Members const & ... members) : data_(layout::padded_size) {
+		set_all(std::tuple<Members...>(members...));
+	}
+
+	/// Sets the I'th member of the block.
+	template<std::size_t I>
+	void set(member_type<I> const & v) {
+		layout::template write<I>(data_.data(), v);
+		dirty_ = true;
+	}
+
+	void set_all(std::tuple<Members...> const & v) {
+		layout::write_all(data_.data(), v);
+		dirty_ = true;
+	}
+
+	void mark_dirty() { dirty_ = true; }
+
+	bool is_dirty() const { return dirty_; }
+
+	/// The data, laid out as it will be uploaded.
+	std::vector<char> const & data() const { return data_; }
+
+	void sync() const {
+		if (!dirty_) return;
+		if (vbo_.size_in_bytes() == data_.size()) {
+			vbo_.write(0, data_.size(), data_.data());
+		} else {
+			vbo_.allocate(data_.size(), data_.data(), GL_DYNAMIC_DRAW);
+		}
+		dirty_ = false;
+	}
+
+	/// Binds the block to the given binding point (after uploading it, if needed).
+	void bind(GLuint binding) const {
+		sync();
+		vbo_.bind_base(GL_UNIFORM_BUFFER, binding);
+	}
+
+	generic_vbo const & vbo() const { return vbo_; }
+
+};
+
+}
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "gl.hpp"
+#include "gl_state.hpp"
 #include "gl_type_traits.hpp"
 #include "vbo.hpp"
 #include "../math/matrix.hpp"
@@ -33,6 +34,57 @@ class vao {
 private:
 	mutable GLuint id = 0;
 
+	// What was last specified for every attribute index and buffer binding point,
+	// such that specifying the same again can be skipped.
+
+	struct attribute_format {
+		bool known = false;
+		GLint size;
+		GLenum type;
+		bool normalize_integers;
+		GLuint relative_offset;
+		GLuint binding;
+		bool operator == (attribute_format const & f) const {
+			return known == f.known && size == f.size && type == f.type && normalize_integers == f.normalize_integers
+				&& relative_offset == f.relative_offset && binding == f.binding;
+		}
+	};
+
+	struct buffer_binding {
+		bool known = false;
+		GLuint buffer;
+		GLintptr offset;
+		GLsizei stride;
+		GLuint divisor;
+		// The serial of the buffer, since its name might be reused for another buffer after it is deleted.
+		std::size_t serial;
+		bool operator == (buffer_binding const & b) const {
+			return known == b.known && buffer == b.buffer && offset == b.offset && stride == b.stride && divisor == b.divisor
+				&& serial == b.serial;
+		}
+	};
+
+	std::vector<attribute_format> formats_;
+	std::vector<buffer_binding> bindings_;
+	std::vector<GLuint> divisors_; // Per attribute, only used without vertex_attrib_binding.
+
+	template<typename T>
+	static T & entry(std::vector<T> & v, GLuint i) {
+		if (v.size() <= i) v.resize(i + 1);
+		return v[i];
+	}
+
+	// Without vertex_attrib_binding, the format and buffer are specified together.
+	void specify(GLuint index) {
+		auto const & f = formats_[index];
+		auto const & b = bindings_[f.binding];
+		gl::state().bind_buffer(GL_ARRAY_BUFFER, b.buffer);
+		gl::vertex_attribute_pointer(index, f.size, f.type, f.normalize_integers, b.stride, reinterpret_cast<void const *>(b.offset + f.relative_offset));
+		auto & d = entry(divisors_, index);
+		if (d != b.divisor) gl::vertex_attribute_divisor(index, b.divisor);
+		d = b.divisor;
+	}
+
 public:
 	explicit vao(bool create_now = false) {
 		if (create_now) create();
@@ -43,20 +95,134 @@ public:
 	vao(vao const &) = delete;
 	vao & operator = (vao const &) = delete;
 
-	vao(vao && v) : id(v.id) { v.id = 0; }
-	vao & operator = (vao && v) { std::swap(id, v.id); return *this; }
+	vao(vao && v) : id(v.id), formats_(std::move(v.formats_)), bindings_(std::move(v.bindings_)), divisors_(std::move(v.divisors_)) { v.id = 0; }
+	vao & operator = (vao && v) {
+		std::swap(id, v.id);
+		std::swap(formats_, v.formats_);
+		std::swap(bindings_, v.bindings_);
+		std::swap(divisors_, v.divisors_);
+		return *this;
+	}
 
 	bool created() const { return id; }
 	explicit operator bool() const { return created(); }
 
-	void create() const { if (!id) gl::generate_vertex_arrays(1, &id); }
-	void destroy() { gl::delete_vertex_arrays(1, &id); id = 0; }
+	void create() const {
+		if (id) return;
+		if (gl::features().direct_state_access) gl::create_vertex_arrays(1, &id);
+		else gl::generate_vertex_arrays(1, &id);
+	}
+
+	void destroy() {
+		gl::delete_vertex_arrays(1, &id);
+		gl::state().deleted_vertex_array(id);
+		id = 0;
+		invalidate();
+	}
 
 	void bind() const {
 		create();
-		gl::bind_vertex_array(id);
+		gl::state().bind_vertex_array(id);
+	}
+
+	/// Forgets what was specified for the attributes and buffer bindings,
+	/// such that everything is specified again the next time.
+	/// \note Needed when the vertex array is changed directly through GL.
+	void invalidate() {
+		formats_.clear();
+		bindings_.clear();
+		divisors_.clear();
+	}
+
+	/// Specifies the format of an attribute, and which buffer binding point it reads from.
+	/// The buffer is bound separately with vertex_buffer(), so a layout can be declared once
+	/// and used with different buffers.
+	/// \param relative_offset The offset of the attribute within an element in the buffer.
+	/// \note Nothing happens if the format was already specified like this.
+	void format(
+		GLuint index,
+		size_t size,
+		GLenum type,
+		bool normalize_integers,
+		GLuint relative_offset,
+		GLuint binding
+	) {
+		auto & f = entry(formats_, index);
+		attribute_format n;
+		n.known = true;
+		n.size = size;
+		n.type = type;
+		n.normalize_integers = normalize_integers;
+		n.relative_offset = relative_offset;
+		n.binding = binding;
+		if (f == n) return;
+		bool enabled = f.known;
+		f = n;
+		if (gl::features().direct_state_access) {
+			create();
+			if (!enabled) gl::enable_vertex_array_attribute(id, index);
+			gl::vertex_array_attribute_format(id, index, size, type, normalize_integers, relative_offset);
+			gl::vertex_array_attribute_binding(id, index, binding);
+		} else if (gl::features().vertex_attrib_binding) {
+			bind();
+			if (!enabled) gl::enable_vertex_attribute_array(index);
+			gl::vertex_attribute_format(index, size, type, normalize_integers, relative_offset);
+			gl::vertex_attribute_binding(index, binding);
+		} else {
+			bind();
+			if (!enabled) gl::enable_vertex_attribute_array(index);
+			if (entry(bindings_, binding).known) specify(index);
+		}
+	}
+
+	/// Binds a buffer to a binding point, for all attributes that read from it. See format().
+	/// \param stride The distance between the elements in bytes. Unlike in attribute(), 0 is not replaced by the size of the element.
+	/// \param divisor 0 for per-vertex data, or n to advance once every n instances.
+	/// \throws gl_error if the divisor is not 0 without gl::features().instanced_arrays.
+	/// \note Nothing happens if the same buffer was already bound like this.
+	void vertex_buffer(
+		GLuint binding,
+		generic_vbo const & vbo,
+		GLintptr offset,
+		GLsizei stride,
+		GLuint divisor = 0
+	) {
+		if (divisor && !gl::features().instanced_arrays) {
+			throw gl_error{"vao::vertex_buffer", "Per-instance attributes are not supported by this context."};
+		}
+		vbo.create();
+		auto & b = entry(bindings_, binding);
+		buffer_binding n;
+		n.known = true;
+		n.buffer = vbo.name();
+		n.offset = offset;
+		n.stride = stride;
+		n.divisor = divisor;
+		n.serial = vbo.serial();
+		if (b == n) return;
+		bool new_divisor = b.known ? b.divisor != divisor : divisor != 0;
+		b = n;
+		if (gl::features().direct_state_access) {
+			create();
+			gl::vertex_array_vertex_buffer(id, binding, n.buffer, offset, stride);
+			if (new_divisor) gl::vertex_array_binding_divisor(id, binding, divisor);
+		} else if (gl::features().vertex_attrib_binding) {
+			bind();
+			gl::bind_vertex_buffer(binding, n.buffer, offset, stride);
+			if (new_divisor) gl::vertex_binding_divisor(binding, divisor);
+		} else {
+			bind();
+			for (GLuint i = 0; i < formats_.size(); ++i) {
+				if (formats_[i].known && formats_[i].binding == binding) specify(i);
+			}
+		}
 	}
 
+	/// Specifies the format and buffer of an attribute at once,
+	/// using the binding point with the same index as the attribute.
+	/// \param divisor 0 for per-vertex data, or n to advance once every n instances.
+	/// \note Only what changed since the last time is specified again, so calling
+	/// this again with only a different vbo costs a single buffer binding.
 	void attribute(
 		GLuint index,
 		generic_vbo const & vbo,
@@ -64,51 +230,73 @@ public:
 		GLenum type,
 		bool normalize_integers,
 		size_t stride,
-		void const * offset
+		void const * offset,
+		GLuint divisor = 0
 	) {
-		bind();
-		vbo.bind(GL_ARRAY_BUFFER);
-		gl::enable_vertex_attribute_array(index);
-		gl::vertex_attribute_pointer(index, size, type, normalize_integers, stride, offset);
+		if (!stride) stride = size * gl_type_size(type);
+		format(index, size, type, normalize_integers, 0, index);
+		vertex_buffer(index, vbo, reinterpret_cast<GLintptr>(offset), stride, divisor);
+	}
+
+	/// Like attribute(), but for a (row-major) matrix with the given number of rows and columns.
+	/// Every row takes its own index, starting at the given index, like a matrix attribute in GLSL.
+	/// All rows read from the binding point with the same index as the first row.
+	/// \note GLSL sees the rows as columns, so the shader should declare the
+	/// transposed type (e.g. mat3x4 for a 3 by 4 matrix), and transpose() it.
+	void matrix_attribute(
+		GLuint index,
+		generic_vbo const & vbo,
+		size_t rows,
+		size_t columns,
+		GLenum type,
+		bool normalize_integers,
+		size_t stride,
+		void const * offset,
+		GLuint divisor = 0
+	) {
+		size_t row_size = columns * gl_type_size(type);
+		if (!stride) stride = rows * row_size;
+		for (size_t r = 0; r < rows; ++r) {
+			format(index + r, columns, type, normalize_integers, r * row_size, index);
+		}
+		vertex_buffer(index, vbo, reinterpret_cast<GLintptr>(offset), stride, divisor);
+	}
+
+	/// The number of indices an attribute of type T takes: the number of rows for matrices, 1 otherwise.
+	template<typename T>
+	static constexpr size_t slots() {
+		return matrix_traits<T>::width == 1 ? 1 : matrix_traits<T>::height;
 	}
 
 	template<typename Element, typename Member>
-	void attribute(GLuint a, vbo<Element> const & vbo, Member Element::* member) {
-		using mt = matrix_traits<Member>;
-		using nt = normalized_type_traits<typename mt::element_type>;
-		attribute(
-			a,
-			vbo,
-			mt::size,
-			gl_type_traits<typename nt::raw_type>::gl_constant,
-			nt::is_normalized_type,
-			sizeof(Element),
-			&(static_cast<Element const *>(nullptr)->*member)
-		);
+	void attribute(GLuint a, vbo<Element> const & vbo, Member Element::* member, GLuint divisor = 0) {
+		typed_attribute<Member>(a, vbo, sizeof(Element), &(static_cast<Element const *>(nullptr)->*member), divisor);
 	}
 
 	template<typename Element>
-	void attribute(GLuint a, vbo<Element> const & vbo) {
-		using mt = matrix_traits<Element>;
+	void attribute(GLuint a, vbo<Element> const & vbo, GLuint divisor = 0) {
+		typed_attribute<Element>(a, vbo, sizeof(Element), nullptr, divisor);
+	}
+
+	template<typename T>
+	void typed_attribute(GLuint a, generic_vbo const & vbo, size_t stride, void const * offset, GLuint divisor = 0) {
+		using mt = matrix_traits<T>;
 		using nt = normalized_type_traits<typename mt::element_type>;
-		attribute(
-			a,
-			vbo,
-			mt::size,
-			gl_type_traits<typename nt::raw_type>::gl_constant,
-			nt::is_normalized_type,
-			sizeof(Element),
-			nullptr
-		);
+		GLenum type = gl_type_traits<typename nt::raw_type>::gl_constant;
+		if (mt::width == 1) {
+			attribute(a, vbo, mt::size, type, nt::is_normalized_type, stride, offset, divisor);
+		} else {
+			matrix_attribute(a, vbo, mt::height, mt::width, type, nt::is_normalized_type, stride, offset, divisor);
+		}
 	}
 
 	// attribute(...) should not be used on temporary VBOs, since VAOs only store a reference.
 
 	template<typename Element, typename Member>
-	void attribute(GLuint, vbo<Element> &&, Member Element::*);
+	void attribute(GLuint, vbo<Element> &&, Member Element::*, GLuint = 0);
 
 	template<typename Element>
-	void attribute(GLuint, vbo<Element> &&);
+	void attribute(GLuint, vbo<Element> &&, GLuint = 0);
 };
 
 }
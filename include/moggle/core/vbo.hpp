@@ -17,10 +17,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <initializer_list>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
 #include "gl.hpp"
+#include "gl_state.hpp"
 
 namespace moggle {
 
@@ -31,6 +37,39 @@ class generic_vbo {
 private:
 	mutable GLuint id = 0;
 
+	// Identifies the buffer, unlike its name, which GL may give to a new buffer after this one is deleted.
+	mutable std::size_t serial_ = 0;
+
+	static std::size_t new_serial() {
+		static std::atomic<std::size_t> next{1};
+		return next++;
+	}
+
+	// The size and capacity are tracked here, so they never have to be queried from GL.
+	std::size_t size_ = 0;
+	std::size_t capacity_ = 0;
+	GLenum usage_ = GL_STATIC_DRAW;
+
+	// Whether the storage was allocated with storage(), and with which flags.
+	// Immutable storage can not be respecified with glBufferData, only replaced by a new buffer.
+	bool immutable_ = false;
+	GLbitfield storage_flags_ = 0;
+
+	// With direct state access, buffers are edited without binding them.
+	// Otherwise, they are bound to GL_ARRAY_BUFFER to edit them.
+
+	static bool dsa() { return gl::features().direct_state_access; }
+
+	void buffer_data(std::size_t bytes, void const * data, GLenum usage) {
+		if (dsa()) {
+			create();
+			gl::named_buffer_data(id, bytes, data, usage);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::buffer_data(GL_ARRAY_BUFFER, bytes, data, usage);
+		}
+	}
+
 public:
 	explicit generic_vbo(bool create_now = false) {
 		if (create_now) create();
@@ -41,18 +80,212 @@ public:
 	generic_vbo(generic_vbo const &) = delete;
 	generic_vbo & operator = (generic_vbo const &) = delete;
 
-	generic_vbo(generic_vbo && v) : id(v.id) { v.id = 0; }
-	generic_vbo & operator = (generic_vbo && v) { std::swap(id, v.id); return *this; }
+	generic_vbo(generic_vbo && v)
+		: id(v.id), serial_(v.serial_), size_(v.size_), capacity_(v.capacity_), usage_(v.usage_), immutable_(v.immutable_), storage_flags_(v.storage_flags_) {
+		v.id = 0;
+		v.size_ = v.capacity_ = 0;
+		v.immutable_ = false;
+	}
+
+	generic_vbo & operator = (generic_vbo && v) {
+		std::swap(id, v.id);
+		std::swap(serial_, v.serial_);
+		std::swap(size_, v.size_);
+		std::swap(capacity_, v.capacity_);
+		std::swap(usage_, v.usage_);
+		std::swap(immutable_, v.immutable_);
+		std::swap(storage_flags_, v.storage_flags_);
+		return *this;
+	}
 
 	bool created() const { return id; }
 	explicit operator bool() const { return created(); }
 
-	void create() const { if (!id) gl::generate_buffers(1, &id); }
-	void destroy() { gl::delete_buffers(1, &id); id = 0; }
+	void create() const {
+		if (id) return;
+		if (dsa()) gl::create_buffers(1, &id);
+		else gl::generate_buffers(1, &id);
+		serial_ = new_serial();
+	}
+
+	void destroy() { gl::delete_buffers(1, &id); gl::state().deleted_buffer(id); id = 0; size_ = capacity_ = 0; immutable_ = false; }
 
 	void bind(GLenum buffer) const {
 		create();
-		gl::bind_buffer(buffer, id);
+		gl::state().bind_buffer(buffer, id);
+	}
+
+	/// Binds the whole buffer to an indexed target, such as GL_UNIFORM_BUFFER.
+	void bind_base(GLenum buffer, GLuint index) const {
+		create();
+		gl::state().bind_buffer_base(buffer, index, id);
+	}
+
+	/// Binds a range (in bytes) of the buffer to an indexed target, such as GL_UNIFORM_BUFFER.
+	void bind_range(GLenum buffer, GLuint index, std::size_t offset, std::size_t bytes) const {
+		create();
+		gl::state().bind_buffer_range(buffer, index, id, offset, bytes);
+	}
+
+	GLuint name() const { return id; }
+
+	/// A number that is different for every buffer ever created, unlike name(). It changes when the buffer is replaced
+	/// (for example when it grows), so anything that remembers this buffer can tell it needs to be bound again.
+	std::size_t serial() const { return serial_; }
+
+	/// The number of bytes in use.
+	std::size_t size_in_bytes() const { return size_; }
+
+	/// The number of bytes allocated on the GPU.
+	std::size_t capacity_in_bytes() const { return capacity_; }
+
+	/// The usage hint used for (re)allocations.
+	GLenum usage() const { return usage_; }
+	void usage(GLenum u) { usage_ = u; }
+
+	/// Whether the storage was allocated with storage().
+	bool immutable() const { return immutable_; }
+
+	/// (Re)allocates the storage to exactly the given size, and fills it with data (if not null).
+	/// \note Immutable storage is replaced by a new buffer.
+	void allocate(std::size_t bytes, void const * data, GLenum usage) {
+		if (immutable_) destroy();
+		buffer_data(bytes, data, usage);
+		size_ = capacity_ = bytes;
+		usage_ = usage;
+	}
+
+	/// Allocates immutable storage (glBufferStorage) of the given size, and fills it with data (if not null).
+	/// \note The storage can not be reallocated afterwards, so growing it moves to a new buffer (see reserve_bytes()).
+	void storage(std::size_t bytes, void const * data, GLbitfield flags) {
+		if (immutable_) destroy();
+		if (dsa()) {
+			create();
+			gl::named_buffer_storage(id, bytes, data, flags);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::buffer_storage(GL_ARRAY_BUFFER, bytes, data, flags);
+		}
+		size_ = capacity_ = bytes;
+		immutable_ = true;
+		storage_flags_ = flags;
+	}
+
+	/// Overwrites a part of the storage, without reallocating it.
+	void write(std::size_t offset, std::size_t bytes, void const * data) {
+		if (offset + bytes > size_) throw std::out_of_range("generic_vbo::write: Range is out of bounds.");
+		if (!bytes) return;
+		if (dsa()) {
+			gl::named_buffer_sub_data(id, offset, bytes, data);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::buffer_sub_data(GL_ARRAY_BUFFER, offset, bytes, data);
+		}
+	}
+
+	/// Copies bytes from another buffer (or another part of this buffer) on the GPU, with glCopyBufferSubData.
+	void copy(generic_vbo const & from, std::size_t read_offset, std::size_t write_offset, std::size_t bytes) {
+		if (read_offset + bytes > from.size_ || write_offset + bytes > size_) throw std::out_of_range("generic_vbo::copy: Range is out of bounds.");
+		if (!bytes) return;
+		if (dsa()) {
+			gl::copy_named_buffer_sub_data(from.id, id, read_offset, write_offset, bytes);
+		} else {
+			from.bind(GL_COPY_READ_BUFFER);
+			bind(GL_COPY_WRITE_BUFFER);
+			gl::copy_buffer_sub_data(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, read_offset, write_offset, bytes);
+		}
+	}
+
+	/// Reads a part of the storage into client memory, with glGetBufferSubData.
+	/// \note This waits for the GPU to finish writing to the buffer. See readback for an asynchronous alternative.
+	void read(std::size_t offset, std::size_t bytes, void * data) const {
+		if (offset + bytes > size_) throw std::out_of_range("generic_vbo::read: Range is out of bounds.");
+		if (!bytes) return;
+		if (dsa()) {
+			gl::get_named_buffer_sub_data(id, offset, bytes, data);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::get_buffer_sub_data(GL_ARRAY_BUFFER, offset, bytes, data);
+		}
+	}
+
+	/// Makes sure at least the given number of bytes are allocated, keeping the contents.
+	/// \note Immutable storage is moved to a new buffer with the same flags.
+	void reserve_bytes(std::size_t bytes) {
+		if (bytes <= capacity_) return;
+		if (!size_ && !immutable_) {
+			buffer_data(bytes, nullptr, usage_);
+		} else {
+			generic_vbo n;
+			if (immutable_) n.storage(bytes, nullptr, storage_flags_);
+			else n.buffer_data(bytes, nullptr, usage_);
+			n.size_ = bytes;
+			n.copy(*this, 0, 0, size_);
+			std::swap(id, n.id);
+			std::swap(serial_, n.serial_);
+		}
+		capacity_ = bytes;
+	}
+
+	/// Changes the number of bytes in use.
+	/// If this does not fit in the capacity, the storage grows geometrically.
+	/// \note New bytes are uninitialized.
+	void resize_bytes(std::size_t bytes) {
+		if (bytes > capacity_) reserve_bytes(std::max(bytes, capacity_ * 2));
+		size_ = bytes;
+	}
+
+	/// Adds data to the end, only reallocating (geometrically) when the capacity is exceeded.
+	void append_bytes(std::size_t bytes, void const * data) {
+		std::size_t offset = size_;
+		resize_bytes(size_ + bytes);
+		write(offset, bytes, data);
+	}
+
+	/// Gives the current storage back to the driver and allocates new storage of the same capacity.
+	/// This way, the new contents can be written without waiting for the GPU to finish using the old contents.
+	/// \note This discards the contents: the size becomes zero.
+	/// \throws std::logic_error for immutable storage, which can not be orphaned.
+	void orphan() {
+		if (immutable_) throw std::logic_error("generic_vbo::orphan: Immutable storage can not be orphaned.");
+		if (capacity_) buffer_data(capacity_, nullptr, usage_);
+		size_ = 0;
+	}
+
+	void * map(GLenum access) const {
+		if (dsa()) {
+			create();
+			return gl::map_named_buffer(id, access);
+		}
+		bind(GL_ARRAY_BUFFER);
+		return gl::map_buffer(GL_ARRAY_BUFFER, access);
+	}
+
+	void * map_bytes(std::size_t offset, std::size_t bytes, GLbitfield access) const {
+		if (dsa()) {
+			create();
+			return gl::map_named_buffer_range(id, offset, bytes, access);
+		}
+		bind(GL_ARRAY_BUFFER);
+		return gl::map_buffer_range(GL_ARRAY_BUFFER, offset, bytes, access);
+	}
+
+	void flush_bytes(std::size_t offset, std::size_t bytes) const {
+		if (dsa()) {
+			gl::flush_mapped_named_buffer_range(id, offset, bytes);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::flush_mapped_buffer_range(GL_ARRAY_BUFFER, offset, bytes);
+		}
+	}
+
+	void unmap() const {
+		if (dsa()) {
+			gl::unmap_named_buffer(id);
+		} else {
+			bind(GL_ARRAY_BUFFER);
+			gl::unmap_buffer(GL_ARRAY_BUFFER);
+		}
 	}
 
 };
@@ -60,17 +293,44 @@ public:
 template<typename T>
 class vbo_mapping {
 private:
-	T * const data_;
+	T * data_;
 	size_t size_;
+	generic_vbo const * vbo_;
 	template<typename> friend class vbo;
-	vbo_mapping(void * data, size_t size)
-		: data_(static_cast<T *>(data)), size_(size) {}
+	vbo_mapping(generic_vbo const & vbo, void * data, size_t size)
+		: data_(static_cast<T *>(data)), size_(size), vbo_(&vbo) {}
 public:
+	vbo_mapping(vbo_mapping && m) : data_(m.data_), size_(m.size_), vbo_(m.vbo_) { m.vbo_ = nullptr; }
+	vbo_mapping & operator = (vbo_mapping && m) {
+		std::swap(data_, m.data_);
+		std::swap(size_, m.size_);
+		std::swap(vbo_, m.vbo_);
+		return *this;
+	}
+
+	vbo_mapping(vbo_mapping const &) = delete;
+	vbo_mapping & operator = (vbo_mapping const &) = delete;
+
 	T * data() const { return data_; }
 	size_t size() const { return size_; }
 	T * begin() const { return data_; }
 	T * end() const { return data_ + size_; }
-	~vbo_mapping() { gl::unmap_buffer(GL_ARRAY_BUFFER); }
+
+	/// Makes the writes to the given elements (relative to the start of the mapping) visible to GL.
+	/// \note Only for mappings made with GL_MAP_FLUSH_EXPLICIT_BIT.
+	void flush(size_t offset, size_t count) const {
+		vbo_->flush_bytes(offset * sizeof(T), count * sizeof(T));
+	}
+
+	void flush() const { flush(0, size_); }
+
+	void unmap() {
+		if (!vbo_) return;
+		vbo_->unmap();
+		vbo_ = nullptr;
+	}
+
+	~vbo_mapping() { unmap(); }
 };
 
 template<typename T>
@@ -105,29 +365,47 @@ public:
 		data(list, usage);
 	}
 
-	size_t size() const {
-		GLint s;
-		bind(GL_ARRAY_BUFFER);
-		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &s);
-		return s / sizeof(T);
-	}
+	size_t size() const { return size_in_bytes() / sizeof(T); }
+
+	size_t capacity() const { return capacity_in_bytes() / sizeof(T); }
 
 	void data(T const * begin, size_t size, GLenum usage = GL_STATIC_DRAW) {
-		bind(GL_ARRAY_BUFFER);
-		gl::buffer_data(
-			GL_ARRAY_BUFFER,
-			size * sizeof(T),
-			begin,
-			usage
-		);
+		allocate(size * sizeof(T), begin, usage);
+	}
+
+	void reserve(size_t size) {
+		reserve_bytes(size * sizeof(T));
+	}
+
+	/// \note Elements that are added are uninitialized.
+	void resize(size_t size) {
+		resize_bytes(size * sizeof(T));
+	}
+
+	/// \note This keeps the allocated storage, like std::vector::clear().
+	void clear() {
+		resize(0);
+	}
+
+	/// Overwrites the elements starting at the given offset, without reallocating.
+	void sub_data(size_t offset, T const * begin, size_t size) {
+		write(offset * sizeof(T), size * sizeof(T), begin);
+	}
+
+	void sub_data(size_t offset, std::vector<T> const & v) {
+		sub_data(offset, v.data(), v.size());
+	}
+
+	void append(T const * begin, size_t size) {
+		append_bytes(size * sizeof(T), begin);
 	}
 
-	void resize(size_t size, GLenum usage = GL_STATIC_DRAW) {
-		bind(nullptr, size, usage);
+	void append(std::vector<T> const & v) {
+		append(v.data(), v.size());
 	}
 
-	void clear(GLenum usage = GL_STATIC_DRAW) {
-		resize(0, usage);
+	void append(std::initializer_list<T> list) {
+		append(list.begin(), list.size());
 	}
 
 	void data(T const * begin, T const * end, GLenum usage = GL_STATIC_DRAW) {
@@ -153,18 +431,24 @@ public:
 	}
 
 	vbo_mapping<T const> map_read_only() const {
-		bind(GL_ARRAY_BUFFER);
-		return { gl::map_buffer(GL_ARRAY_BUFFER, GL_READ_ONLY), size() };
+		return { *this, map(GL_READ_ONLY), size() };
 	}
 
 	vbo_mapping<T> map_write_only() const {
-		bind(GL_ARRAY_BUFFER);
-		return { gl::map_buffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY), size() };
+		return { *this, map(GL_WRITE_ONLY), size() };
 	}
 
 	vbo_mapping<T> map_read_write() const {
-		bind(GL_ARRAY_BUFFER);
-		return { gl::map_buffer(GL_ARRAY_BUFFER, GL_READ_WRITE), size() };
+		return { *this, map(GL_READ_WRITE), size() };
+	}
+
+	/// Maps only count elements, starting at offset.
+	/// \param access GL_MAP_READ_BIT and/or GL_MAP_WRITE_BIT, optionally combined with
+	/// GL_MAP_INVALIDATE_RANGE_BIT, GL_MAP_INVALIDATE_BUFFER_BIT, GL_MAP_UNSYNCHRONIZED_BIT
+	/// and GL_MAP_FLUSH_EXPLICIT_BIT (see vbo_mapping::flush()).
+	vbo_mapping<T> map_range(size_t offset, size_t count, GLbitfield access = GL_MAP_WRITE_BIT) const {
+		if (offset + count > size()) throw std::out_of_range("vbo::map_range: Range is out of bounds.");
+		return { *this, map_bytes(offset * sizeof(T), count * sizeof(T), access), count };
 	}
 
 };
@@ -20,6 +20,7 @@
 #include <initializer_list>
 #include <memory>
 #include <vector>
+#include "../core/readback.hpp"
 #include "../core/vbo.hpp"
 
 namespace moggle {
@@ -29,6 +30,16 @@ class generic_buffer {
 protected:
 	mutable generic_vbo vbo_;
 
+	// Where this buffer is, shared with its pending uploads.
+	// Follows the buffer when it is moved, and is set to null when it is destroyed,
+	// such that applying a pending upload afterwards does nothing.
+	std::shared_ptr<generic_buffer *> self_;
+
+	std::shared_ptr<generic_buffer *> const & self() {
+		if (!self_) self_ = std::make_shared<generic_buffer *>(this);
+		return self_;
+	}
+
 	generic_buffer() {}
 
 	// A buffer and a copy of it do not share the same vbo, the copy uses a new vbo.
@@ -36,7 +47,9 @@ protected:
 	// Therefore, this copy constructor does *not* copy vbo_.
 	generic_buffer(generic_buffer const &) {}
 
-	generic_buffer(generic_buffer && other) : vbo_(std::move(other.vbo_)) {}
+	generic_buffer(generic_buffer && other) : vbo_(std::move(other.vbo_)), self_(std::move(other.self_)) {
+		if (self_) *self_ = this;
+	}
 
 	generic_buffer & operator = (generic_buffer const &) {
 		return *this;
@@ -44,6 +57,9 @@ protected:
 
 	generic_buffer & operator = (generic_buffer && other) {
 		vbo_ = std::move(other.vbo_);
+		if (self_) *self_ = nullptr;
+		self_ = std::move(other.self_);
+		if (self_) *self_ = this;
 		return *this;
 	}
 
@@ -54,10 +70,52 @@ public:
 
 	virtual void sync() const = 0;
 
+	/// Marks the data on the CPU as synchronized, such that sync() does not overwrite what is in the vbo.
+	virtual void mark_clean() = 0;
+
+	/// Syncs, and binds the vbo to the given shader storage buffer binding point.
+	/// \note The elements are read by the shader with the std430 layout, which matches
+	/// the layout in memory for scalars, vector2 and vector4, but not for vector3, structs with padding,
+	/// or matrices (which moggle stores row-major). Use ssbo for those.
+	void bind_storage(GLuint binding) const {
+		sync();
+		vbo_.bind_base(GL_SHADER_STORAGE_BUFFER, binding);
+	}
+
+	/// An upload of the data of a buffer into a new vbo, which can be done on another thread
+	/// with a shared context (see upload_thread).
+	struct pending_upload {
+		/// Uploads the data into the new vbo. Can be called from another thread.
+		virtual void upload() = 0;
+		/// Replaces the vbo of the buffer by the new one. Only call this after the upload has finished on the GPU.
+		/// Does nothing if the buffer was destroyed in the meantime.
+		virtual void apply() = 0;
+		virtual ~pending_upload() {}
+	};
+
+	/// Takes a copy of the data for a pending_upload, and marks the buffer as synchronized,
+	/// so the old vbo keeps being used until the pending_upload is applied.
+	virtual std::unique_ptr<pending_upload> start_upload() = 0;
+
 	generic_vbo const & vbo() const { return vbo_; }
 	operator generic_vbo const & () const { return vbo(); }
 
-	virtual ~generic_buffer() {}
+	/// The vbo, for changing its contents on the GPU directly (for example with generic_vbo::copy()).
+	/// \note Such changes are overwritten by the next sync() of changed data on the CPU.
+	generic_vbo & mutable_vbo() { return vbo_; }
+
+	/// Makes the vbo the given size, for data that is written on the GPU (for example by mesh::capture())
+	/// instead of synced from the CPU. Nothing is reallocated if it already has this size.
+	/// \note The data on the CPU is left alone, and is no longer in sync with the vbo (see sync_back()).
+	/// Use mark_clean() to keep sync() from uploading it over the data written on the GPU.
+	void allocate_vbo(std::size_t bytes, GLenum usage = GL_DYNAMIC_COPY) {
+		if (vbo_.size_in_bytes() == bytes && vbo_.capacity_in_bytes() == bytes) return;
+		vbo_.allocate(bytes, nullptr, usage);
+	}
+
+	virtual ~generic_buffer() {
+		if (self_) *self_ = nullptr;
+	}
 
 };
 
@@ -69,6 +127,9 @@ private:
 
 	mutable bool dirty_ = !std::vector<T>::empty();
 
+	// Only created when used, since most buffers are never read back.
+	std::unique_ptr<readback> readback_;
+
 public:
 	buffer() : std::vector<T>() {}
 	explicit buffer(typename std::vector<T>::size_type count, T const & value) : std::vector<T>(count, value) {}
@@ -83,6 +144,7 @@ public:
 	buffer & operator = (buffer const & other) {
 		std::vector<T>::operator = (other);
 		dirty_ = true;
+		return *this;
 	}
 
 	buffer(buffer &&) = default;
@@ -90,6 +152,8 @@ public:
 
 	void mark_dirty() { dirty_ = true; }
 
+	virtual void mark_clean() override { dirty_ = false; }
+
 	bool is_dirty() const { return dirty_; }
 
 	virtual void sync() const override {
@@ -99,11 +163,50 @@ public:
 		}
 	}
 
+	virtual std::unique_ptr<pending_upload> start_upload() override {
+		struct upload_t : pending_upload {
+			std::shared_ptr<generic_buffer *> target;
+			std::vector<T> data;
+			GLenum usage;
+			vbo_t vbo;
+			upload_t(std::shared_ptr<generic_buffer *> target, std::vector<T> const & data, GLenum usage)
+				: target(std::move(target)), data(data), usage(usage) {}
+			virtual void upload() override {
+				vbo.data(data, usage);
+				std::vector<T>().swap(data);
+			}
+			virtual void apply() override {
+				if (*target) static_cast<buffer *>(*target)->vbo_ = std::move(vbo);
+			}
+		};
+		dirty_ = false;
+		return std::unique_ptr<pending_upload>(new upload_t(self(), *this, vbo_.usage()));
+	}
+
 	void sync_back() {
 		auto m = vbo().map_read_only();
 		std::vector<T>::assign(m.data(), m.data() + vbo().size());
 	}
 
+	/// Starts copying the data on the GPU back, without waiting for the GPU to finish writing it.
+	/// Use sync_back_ready() and finish_sync_back() to get the data.
+	void sync_back_async() {
+		if (!readback_) readback_.reset(new readback);
+		readback_->start(vbo_, 0, vbo_.size_in_bytes());
+	}
+
+	/// Whether finish_sync_back() can be called without waiting.
+	bool sync_back_ready() const { return readback_ && readback_->ready(); }
+
+	/// Replaces the data by the data read back by sync_back_async(), waiting for it if it is not ready yet.
+	/// Does nothing if sync_back_async() was not called.
+	void finish_sync_back() {
+		if (!readback_ || !readback_->started()) return;
+		std::vector<T>::resize(readback_->size_in_bytes() / sizeof(T));
+		readback_->read(std::vector<T>::data());
+		dirty_ = false;
+	}
+
 	vbo_t const & vbo() const { return static_cast<vbo_t const &>(generic_buffer::vbo()); }
 	operator vbo_t const & () const { return vbo(); }
 
@@ -0,0 +1,204 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../core/shader.hpp"
+#include "mesh.hpp"
+#include "shader_pipeline.hpp"
+
+namespace moggle {
+
+/// A list of operations, recorded without a GL context (e.g. on a worker thread), to be replay()ed on the render thread.
+/// \note The list only refers to the pipelines and meshes, so they must stay alive until it is replayed.
+class command_list {
+
+private:
+	struct command {
+		command * next = nullptr;
+		virtual void execute() = 0;
+		virtual ~command() {}
+	};
+
+	template<typename F>
+	struct function_command : command {
+		F f;
+		explicit function_command(F && f) : f(std::move(f)) {}
+		virtual void execute() override { f(); }
+	};
+
+	struct block {
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+	};
+
+	std::size_t block_size_;
+	std::vector<block> blocks_;
+	std::size_t current_block_ = 0;
+	std::size_t used_ = 0; // In the current block.
+
+	command * first_ = nullptr;
+	command * last_ = nullptr;
+	std::size_t size_ = 0;
+
+	void * allocate(std::size_t bytes, std::size_t alignment) {
+		for (; current_block_ < blocks_.size(); ++current_block_, used_ = 0) {
+			std::size_t offset = (used_ + alignment - 1) / alignment * alignment;
+			if (offset + bytes <= blocks_[current_block_].size) {
+				used_ = offset + bytes;
+				return blocks_[current_block_].data.get() + offset;
+			}
+		}
+		std::size_t size = std::max(bytes, block_size_);
+		blocks_.push_back(block{std::unique_ptr<char[]>(new char[size]), size});
+		used_ = bytes;
+		return blocks_.back().data.get();
+	}
+
+	char const * copy(char const * s) {
+		std::size_t n = std::strlen(s) + 1;
+		return static_cast<char const *>(std::memcpy(allocate(n, 1), s, n));
+	}
+
+	template<typename T>
+	T const * copy(T const * values, std::size_t count) {
+		static_assert(std::is_trivially_destructible<T>::value, "Only trivially destructible values can be copied into a command_list.");
+		T * p = static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+		std::uninitialized_copy(values, values + count, p);
+		return p;
+	}
+
+	static shader_program const & active_program() {
+		auto p = pipeline::active_pipeline();
+		if (!p) throw uniform_error{"No pipeline in use to set the uniform of."};
+		return p->program();
+	}
+
+public:
+	/// \param block_size The size in bytes of the blocks the commands are stored in.
+	explicit command_list(std::size_t block_size = 64 * 1024) : block_size_(block_size) {}
+
+	~command_list() { clear(); }
+
+	command_list(command_list const &) = delete;
+	command_list & operator = (command_list const &) = delete;
+
+	command_list(command_list && l) : block_size_(l.block_size_) { swap(l); }
+	command_list & operator = (command_list && l) { swap(l); return *this; }
+
+	void swap(command_list & l) {
+		std::swap(block_size_, l.block_size_);
+		std::swap(blocks_, l.blocks_);
+		std::swap(current_block_, l.current_block_);
+		std::swap(used_, l.used_);
+		std::swap(first_, l.first_);
+		std::swap(last_, l.last_);
+		std::swap(size_, l.size_);
+	}
+
+	/// The number of recorded commands.
+	std::size_t size() const { return size_; }
+	bool empty() const { return !size_; }
+
+	/// Removes all commands, keeping the memory for the next recording.
+	void clear() {
+		for (command * c = first_; c;) {
+			command * next = c->next;
+			c->~command();
+			c = next;
+		}
+		first_ = last_ = nullptr;
+		size_ = 0;
+		current_block_ = used_ = 0;
+	}
+
+	/// Records a call to f, which is called on the render thread when replaying.
+	template<typename F>
+	void call(F f) {
+		using C = function_command<F>;
+		command * c = new (allocate(sizeof(C), alignof(C))) C(std::move(f));
+		(last_ ? last_->next : first_) = c;
+		last_ = c;
+		++size_;
+	}
+
+	/// Executes the commands in the order they were recorded.
+	/// \note The list is not cleared, so it can be replayed again.
+	void replay() {
+		for (command * c = first_; c; c = c->next) c->execute();
+	}
+
+	void use(pipeline const & p) {
+		call([&p] { p.use(); });
+	}
+
+	/// Sets a uniform of the pipeline that is in use at that point when replaying.
+	/// \note The uniform is looked up while replaying. Use the overload taking a
+	/// shader_uniform_setter to look it up only once.
+	template<typename T>
+	void uniform(char const * name, T const & value) {
+		char const * n = copy(name);
+		call([n, value] { active_program().uniform<T>(n).set(value); });
+	}
+
+	template<typename T>
+	void uniform(std::string const & name, T const & value) {
+		uniform(name.c_str(), value);
+	}
+
+	template<typename T>
+	void uniform(shader_uniform_setter<T> setter, T const & value) {
+		call([setter, value] () mutable { setter.set(value); });
+	}
+
+	/// Sets an array uniform. The values are copied into the list.
+	template<typename T>
+	void uniform(shader_uniform_setter<T> setter, T const * values, std::size_t count) {
+		T const * v = copy(values, count);
+		call([setter, v, count] () mutable { setter.set(v, count); });
+	}
+
+	/// Draws a mesh with the pipeline that is in use at that point when replaying.
+	/// This binds the vertices and indices of the mesh.
+	void draw(mesh const & m) {
+		call([&m] { m.draw(); });
+	}
+
+	void draw_instanced(mesh const & m, GLsizei count) {
+		call([&m, count] { m.draw_instanced(count); });
+	}
+
+	/// Records replaying another list as part of this one, such that the lists
+	/// of several workers can be replayed as one.
+	/// \note Only refers to the other list, which must stay alive until this one is replayed.
+	void include(command_list & l) {
+		call([&l] { l.replay(); });
+	}
+
+};
+
+}
@@ -0,0 +1,200 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../core/range_allocator.hpp"
+#include "buffer.hpp"
+#include "mesh.hpp"
+#include "vertices.hpp"
+
+namespace moggle {
+
+/// Stores many small meshes in shared vertex and index buffers, each drawing its own range (see mesh::index_range()).
+/// \note The arena must outlive the meshes it returns. Their space is freed when they are destroyed.
+class geometry_arena {
+
+private:
+	struct allocation {
+		std::size_t first_vertex;
+		std::size_t vertex_count;
+		std::size_t first_index;
+		std::size_t index_count;
+	};
+
+	std::shared_ptr<class vertices> vertices_ = std::make_shared<class vertices>();
+	std::shared_ptr<buffer<GLushort>> indices_ = std::make_shared<buffer<GLushort>>();
+
+	range_allocator vertex_space_;
+	range_allocator index_space_;
+
+	std::map<mesh *, allocation> meshes_;
+
+	// Allocates a range, growing the space and the buffers (by resize(new_capacity)) if needed.
+	template<typename F>
+	static std::size_t allocate(range_allocator & space, std::size_t size, F resize) {
+		std::size_t offset = space.allocate(size);
+		if (offset != range_allocator::none) return offset;
+		std::size_t capacity = std::max(space.capacity() * 2, space.capacity() + size);
+		resize(capacity);
+		space.grow(capacity);
+		return space.allocate(size);
+	}
+
+	void resize_vertices(std::size_t capacity) {
+		for (auto const & a : vertices_->attributes()) {
+			a.second.buffer->mutable_vbo().resize_bytes(capacity * a.second.size_of_type);
+		}
+	}
+
+	void resize_indices(std::size_t capacity) {
+		indices_->mutable_vbo().resize_bytes(capacity * sizeof(GLushort));
+	}
+
+	void remove(mesh * m) {
+		auto i = meshes_.find(m);
+		vertex_space_.free(i->second.first_vertex, i->second.vertex_count);
+		index_space_.free(i->second.first_index, i->second.index_count);
+		meshes_.erase(i);
+	}
+
+	// Copies the given ranges of v packed into a new vbo of the same size, and replaces v by it.
+	static void compact(generic_vbo & v, std::vector<std::pair<std::size_t, std::size_t>> const & ranges, std::size_t element_size) {
+		generic_vbo n;
+		n.allocate(v.size_in_bytes(), nullptr, v.usage());
+		std::size_t offset = 0;
+		for (auto const & r : ranges) {
+			n.copy(v, r.first * element_size, offset * element_size, r.second * element_size);
+			offset += r.second;
+		}
+		v = std::move(n);
+	}
+
+public:
+	/// \param vertex_capacity The initial number of vertices that fit in the buffers.
+	/// \param index_capacity The initial number of indices that fit in the index buffer.
+	/// The buffers grow when needed.
+	explicit geometry_arena(std::size_t vertex_capacity = 1 << 16, std::size_t index_capacity = 1 << 18)
+		: vertex_space_(vertex_capacity), index_space_(index_capacity) {
+		indices_->allocate_vbo(index_capacity * sizeof(GLushort), GL_STATIC_DRAW);
+	}
+
+	geometry_arena(geometry_arena const &) = delete;
+	geometry_arena & operator = (geometry_arena const &) = delete;
+
+	/// Adds an attribute to the vertex format of the arena.
+	/// \throws std::logic_error if the arena already contains meshes.
+	template<typename T>
+	void attribute(std::string const & name) {
+		if (!meshes_.empty()) throw std::logic_error("geometry_arena::attribute: The arena already contains meshes.");
+		auto b = std::make_shared<buffer<T>>();
+		b->allocate_vbo(vertex_space_.capacity() * sizeof(T), GL_STATIC_DRAW);
+		vertices_->attribute(name, std::move(b));
+	}
+
+	/// Copies the vertices and indices of a mesh into the arena, and returns a mesh that draws them from there.
+	/// The source vertices can have more attributes than the arena, those are ignored.
+	/// \throws attribute_error if an attribute of the arena is missing or has a different type.
+	std::shared_ptr<mesh> add(class vertices const & source, buffer<GLushort> const & indices) {
+		for (auto const & a : vertices_->attributes()) {
+			source.attribute(a.first).generic_buffer()->sync();
+			auto const & s = source.attributes().at(a.first);
+			if (
+				s.type != a.second.type ||
+				s.width != a.second.width ||
+				s.height != a.second.height ||
+				s.normalized != a.second.normalized ||
+				s.size_of_type != a.second.size_of_type
+			) {
+				throw attribute_error{"Type mismatch for attribute: " + a.first};
+			}
+		}
+		indices.sync();
+		allocation r;
+		r.vertex_count = source.size();
+		r.index_count = indices.vbo().size();
+		r.first_vertex = allocate(vertex_space_, r.vertex_count, [this] (std::size_t c) { resize_vertices(c); });
+		r.first_index = allocate(index_space_, r.index_count, [this] (std::size_t c) { resize_indices(c); });
+		for (auto const & a : vertices_->attributes()) {
+			std::size_t size = a.second.size_of_type;
+			a.second.buffer->mutable_vbo().copy(source.attributes().at(a.first).buffer->vbo(), 0, r.first_vertex * size, r.vertex_count * size);
+		}
+		indices_->mutable_vbo().copy(indices.vbo(), 0, r.first_index * sizeof(GLushort), r.index_count * sizeof(GLushort));
+		std::shared_ptr<mesh> m{new mesh{vertices_, indices_}, [this] (mesh * m) { remove(m); delete m; }};
+		m->index_range(r.first_index, r.index_count, r.first_vertex);
+		meshes_[m.get()] = r;
+		return m;
+	}
+
+	/// Moves all meshes to the start of the buffers, such that all free space is in one piece at the end.
+	/// The meshes returned by add() are updated to draw from their new place.
+	/// \note Use the free_ranges() of vertex_space() and index_space() to decide when this is worth it.
+	void defragment() {
+		using entry = std::pair<mesh * const, allocation>;
+		std::vector<entry *> by_vertex, by_index;
+		for (auto & m : meshes_) {
+			by_vertex.push_back(&m);
+			by_index.push_back(&m);
+		}
+		std::sort(by_vertex.begin(), by_vertex.end(), [] (entry const * a, entry const * b) {
+			return a->second.first_vertex < b->second.first_vertex;
+		});
+		std::sort(by_index.begin(), by_index.end(), [] (entry const * a, entry const * b) {
+			return a->second.first_index < b->second.first_index;
+		});
+		std::vector<std::pair<std::size_t, std::size_t>> vertex_ranges, index_ranges;
+		vertex_space_.clear();
+		index_space_.clear();
+		for (auto m : by_vertex) {
+			vertex_ranges.emplace_back(m->second.first_vertex, m->second.vertex_count);
+			m->second.first_vertex = vertex_space_.allocate(m->second.vertex_count);
+		}
+		for (auto m : by_index) {
+			index_ranges.emplace_back(m->second.first_index, m->second.index_count);
+			m->second.first_index = index_space_.allocate(m->second.index_count);
+		}
+		for (auto const & a : vertices_->attributes()) {
+			compact(a.second.buffer->mutable_vbo(), vertex_ranges, a.second.size_of_type);
+		}
+		compact(indices_->mutable_vbo(), index_ranges, sizeof(GLushort));
+		for (auto const & m : meshes_) {
+			m.first->index_range(m.second.first_index, m.second.index_count, m.second.first_vertex);
+		}
+	}
+
+	/// The vertices shared by all meshes in the arena.
+	std::shared_ptr<class vertices> vertices() const { return vertices_; }
+
+	/// The indices shared by all meshes in the arena.
+	std::shared_ptr<buffer<GLushort>> indices() const { return indices_; }
+
+	/// The number of meshes in the arena.
+	std::size_t size() const { return meshes_.size(); }
+
+	range_allocator const & vertex_space() const { return vertex_space_; }
+	range_allocator const & index_space() const { return index_space_; }
+
+};
+
+}
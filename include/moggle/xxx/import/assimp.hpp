@@ -18,14 +18,31 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <moggle/xxx/mesh.hpp>
 
 namespace moggle {
 
-mesh import_mesh(char const * file_name);
-inline mesh import_mesh(std::string const & file_name) {
-	return import_mesh(file_name.data());
+struct import_options {
+	/// The narrowest index type to use. Every mesh gets the narrowest type that fits (see index_type_for()).
+	GLenum smallest_index_type = GL_UNSIGNED_SHORT;
+	/// Whether to split meshes with more vertices than 16-bit indices can address into
+	/// several meshes, instead of using 32-bit indices.
+	bool split_large_meshes = false;
+};
+
+/// Imports the first mesh in the file.
+/// The indices get the narrowest type that fits, but not narrower than smallest_index_type.
+mesh import_mesh(char const * file_name, GLenum smallest_index_type = GL_UNSIGNED_SHORT);
+inline mesh import_mesh(std::string const & file_name, GLenum smallest_index_type = GL_UNSIGNED_SHORT) {
+	return import_mesh(file_name.data(), smallest_index_type);
+}
+
+/// Imports all meshes in the file that consist of triangles.
+std::vector<mesh> import_meshes(char const * file_name, import_options const & options = import_options());
+inline std::vector<mesh> import_meshes(std::string const & file_name, import_options const & options = import_options()) {
+	return import_meshes(file_name.data(), options);
 }
 
 }
@@ -17,11 +17,19 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 
+#include "../core/draw_batch.hpp"
+#include "../core/gl_type_traits.hpp"
+#include "../core/query.hpp"
+#include "../core/transform_feedback.hpp"
 #include "buffer.hpp"
 #include "vertices.hpp"
 #include "shader_pipeline.hpp"
+#include "upload_thread.hpp"
 
 namespace moggle {
 
@@ -37,36 +45,186 @@ public:
 	operator std::shared_ptr<T> const & () const { return p; }
 };
 
+/// The narrowest index type that can index the given number of vertices:
+/// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, but not narrower than smallest.
+/// \note Many GPUs handle GL_UNSIGNED_BYTE indices slowly, which is why it is not the default smallest type.
+inline GLenum index_type_for(std::size_t vertex_count, GLenum smallest = GL_UNSIGNED_SHORT) {
+	if (vertex_count <= 0x100 && smallest == GL_UNSIGNED_BYTE) return GL_UNSIGNED_BYTE;
+	if (vertex_count <= 0x10000 && smallest != GL_UNSIGNED_INT) return GL_UNSIGNED_SHORT;
+	return GL_UNSIGNED_INT;
+}
+
 class mesh {
 
 private:
 	std::shared_ptr<class vertices> vertices_;
-	std::shared_ptr<buffer<GLushort>> indices_;
+	std::shared_ptr<generic_buffer> indices_;
+	GLenum index_type_ = GL_UNSIGNED_SHORT;
 
-public:
-	explicit mesh(
-		implicit_shared<class vertices> v,
-		implicit_shared<buffer<GLushort>> i = nullptr
-	) : vertices_(v), indices_(i) {}
+	// The part of indices_ to draw. A count of -1 means up to the end.
+	std::size_t first_index_ = 0;
+	std::size_t index_count_ = std::size_t(-1);
+	GLint base_vertex_ = 0;
 
-	std::shared_ptr<class vertices> vertices() { return vertices_; }
+	// Set while the data is uploaded by an upload_thread for the first time.
+	upload_thread::ticket first_upload_;
 
-	void draw() const {
-		GLuint i = 0;
-		for (auto const & a : pipeline::active_pipeline()->vertex_attributes()) {
-			vertices_->attribute(a.name).use(i++); // TODO: check type
+	// Sets up the attributes for the active pipeline and binds the vertex array and index buffer.
+	// Returns false if there is nothing to draw yet.
+	bool prepare() const {
+		if (first_upload_ && !first_upload_.done()) return false;
+		auto const & p = *pipeline::active_pipeline();
+		for (std::size_t i = 0; i < p.vertex_attributes().size(); ++i) {
+			vertices_->attribute(p.vertex_attributes()[i].name).use(p.vertex_attribute_locations()[i]); // TODO: check type
 		}
 		vertices_->bind();
 		if (indices_) {
 			indices_->sync();
 			indices_->bind(GL_ELEMENT_ARRAY_BUFFER);
-			gl::draw_elements(GL_TRIANGLES, indices_->size(), GL_UNSIGNED_SHORT, nullptr);
+		}
+		return true;
+	}
+
+	void const * index_offset() const {
+		return reinterpret_cast<void const *>(first_index_ * gl_type_size(index_type_));
+	}
+
+public:
+	explicit mesh(implicit_shared<class vertices> v) : vertices_(v) {}
+
+	// One constructor per index type, since implicit_shared can't be deduced.
+
+	mesh(implicit_shared<class vertices> v, implicit_shared<buffer<GLubyte>> i)
+		: vertices_(v) { indices<GLubyte>(i); }
+	mesh(implicit_shared<class vertices> v, implicit_shared<buffer<GLushort>> i)
+		: vertices_(v) { indices<GLushort>(i); }
+	mesh(implicit_shared<class vertices> v, implicit_shared<buffer<GLuint>> i)
+		: vertices_(v) { indices<GLuint>(i); }
+
+	/// \param index_type The type of the indices: GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	mesh(implicit_shared<class vertices> v, std::shared_ptr<generic_buffer> i, GLenum index_type)
+		: vertices_(v), indices_(std::move(i)), index_type_(index_type) {}
+
+	std::shared_ptr<class vertices> vertices() { return vertices_; }
+
+	std::shared_ptr<generic_buffer> indices() { return indices_; }
+
+	/// The indices, or null if they are not of type Index.
+	template<typename Index>
+	std::shared_ptr<buffer<Index>> indices() {
+		return std::dynamic_pointer_cast<buffer<Index>>(indices_);
+	}
+
+	/// Replaces the indices. Index is GLubyte, GLushort or GLuint.
+	template<typename Index>
+	void indices(std::shared_ptr<buffer<Index>> i) {
+		static_assert(std::is_same<Index, GLubyte>::value || std::is_same<Index, GLushort>::value || std::is_same<Index, GLuint>::value,
+			"Indices must be GLubyte, GLushort or GLuint.");
+		indices_ = std::move(i);
+		index_type_ = gl_type_traits<Index>::gl_constant;
+	}
+
+	/// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	GLenum index_type() const { return index_type_; }
+
+	/// Makes this mesh only a part of the index buffer, for meshes that share their vertices and indices.
+	/// Every index is offset by base_vertex.
+	void index_range(std::size_t first, std::size_t count, GLint base_vertex = 0) {
+		first_index_ = first;
+		index_count_ = count;
+		base_vertex_ = base_vertex;
+	}
+
+	std::size_t first_index() const { return first_index_; }
+	std::size_t index_count() const {
+		if (index_count_ != std::size_t(-1) || !indices_) return index_count_;
+		indices_->sync();
+		return indices_->vbo().size_in_bytes() / gl_type_size(index_type_) - first_index_;
+	}
+	GLint base_vertex() const { return base_vertex_; }
+
+	/// Uploads the vertices and indices on the given upload thread, instead of while drawing.
+	/// Until the upload is done, the old data is drawn, or nothing if there was no old data.
+	void upload(upload_thread & u) {
+		std::vector<generic_buffer *> buffers;
+		for (auto const & a : vertices_->attributes()) buffers.push_back(a.second.buffer.get());
+		if (indices_) buffers.push_back(indices_.get());
+		// Nothing can be drawn until the upload is done if any of the buffers has no old data.
+		bool first = std::any_of(buffers.begin(), buffers.end(), [] (generic_buffer const * b) { return !b->vbo().size_in_bytes(); });
+		auto t = u.upload(buffers);
+		if (first) first_upload_ = t;
+	}
+
+	void draw() const {
+		if (!prepare()) return;
+		if (indices_) {
+			if (base_vertex_) {
+				gl::draw_elements_base_vertex(GL_TRIANGLES, index_count(), index_type_, index_offset(), base_vertex_);
+			} else {
+				gl::draw_elements(GL_TRIANGLES, index_count(), index_type_, index_offset());
+			}
+		} else {
+			gl::draw_arrays(GL_TRIANGLES, 0, vertices_->size());
+		}
+	}
+
+	/// Draws this mesh only if samples passed for the given (occlusion) query, as decided by the GPU.
+	/// \param mode GL_QUERY_NO_WAIT to draw anyway if the result is not yet available, or GL_QUERY_WAIT to let the GPU wait for it.
+	/// \see occlusion_queries
+	void draw(query const & condition, GLenum mode = GL_QUERY_NO_WAIT) const {
+		gl::begin_conditional_render(condition.name(), mode);
+		draw();
+		gl::end_conditional_render();
+	}
+
+	/// Draws count instances of this mesh.
+	/// Attributes with a divisor (see vertices::attribute()) advance per instance instead of per vertex.
+	void draw_instanced(GLsizei count) const {
+		if (!prepare()) return;
+		if (indices_) {
+			if (base_vertex_) {
+				gl::draw_elements_instanced_base_vertex(GL_TRIANGLES, index_count(), index_type_, index_offset(), count, base_vertex_);
+			} else {
+				gl::draw_elements_instanced(GL_TRIANGLES, index_count(), index_type_, index_offset(), count);
+			}
 		} else {
-			// TODO: gl::draw_arrays(GL_TRIANGLES, 0, vertices_->size());
-			// There is no vertices::size().
+			gl::draw_arrays_instanced(GL_TRIANGLES, 0, vertices_->size(), count);
 		}
 	}
 
+	/// Captures the pipeline::captured_outputs of the active pipeline for every vertex into the existing attributes with the same names in destination.
+	/// \note The captured data is only on the GPU. See buffer::sync_back().
+	void capture(transform_feedback & feedback, class vertices & destination) const {
+		if (!prepare()) return;
+		auto const & p = *pipeline::active_pipeline();
+		std::size_t n = vertices_->size();
+		std::vector<generic_vbo const *> outputs;
+		for (auto const & c : p.captured_outputs) {
+			auto b = destination.attribute(c.name).generic_buffer();
+			b->allocate_vbo(n * destination.attributes().at(c.name).size_of_type);
+			b->mark_clean(); // Otherwise, old data on the CPU would be uploaded over the captured data.
+			outputs.push_back(&b->vbo());
+		}
+		feedback.begin(GL_POINTS, outputs);
+		gl::draw_arrays(GL_POINTS, 0, n);
+		feedback.end();
+	}
+
+	/// Adds this mesh to a batch of meshes that share its vertices and indices.
+	/// \return The draw id.
+	/// \throws std::logic_error if the mesh has no indices.
+	std::size_t add_to(draw_batch & batch, GLuint instance_count = 1) const {
+		if (!indices_) throw std::logic_error("mesh::add_to: Only meshes with indices can be drawn in a batch.");
+		return batch.add(index_count(), first_index_, base_vertex_, instance_count);
+	}
+
+	/// Draws a batch of meshes that share the vertices and indices of this mesh.
+	/// \see draw_batch::submit()
+	void draw(draw_batch & batch, std::function<void(std::size_t draw_id)> const & set_draw_id = nullptr) const {
+		if (!indices_ || !prepare()) return;
+		batch.submit(GL_TRIANGLES, index_type_, set_draw_id);
+	}
+
 };
 
 }
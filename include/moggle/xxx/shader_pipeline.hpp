@@ -25,7 +25,9 @@
 #include <string>
 #include <vector>
 #include <moggle/math/matrix.hpp>
+#include <moggle/core/program_cache.hpp>
 #include <moggle/core/shader.hpp>
+#include <moggle/core/shader_batch.hpp>
 #include <moggle/xxx/vertices.hpp>
 
 namespace moggle {
@@ -93,7 +95,8 @@ public:
 	void compile_source(pipeline &);
 
 	/// Generates the sources for the given pipeline and compiles and links them.
-	void compile(pipeline &);
+	/// \param cache If given, the linked program is loaded from or stored in this cache.
+	void compile(pipeline &, program_binary_cache const * cache = nullptr);
 
 };
 
@@ -168,14 +171,24 @@ public:
 	};
 	std::set<variable> fragment_outputs;
 
+	/// Variables of the vertex operations to capture with transform feedback (see mesh::capture()),
+	/// each into its own buffer, in the order of this set.
+	std::set<variable> captured_outputs;
+
 private:
 	std::string vertex_shader_source_;
 	std::string fragment_shader_source_;
 
 	std::vector<variable> vertex_attributes_;
+	std::vector<GLuint> vertex_attribute_locations_;
 
 	shader_program program_;
 
+	// While compiling asynchronously:
+	std::vector<shader> pending_shaders_;
+	program_binary_cache const * pending_cache_ = nullptr;
+	std::string pending_key_;
+
 	friend class compiler;
 
 public:
@@ -184,11 +197,28 @@ public:
 
 	std::vector<variable> const & vertex_attributes() const { return vertex_attributes_; }
 
+	/// The location of every vertex attribute. Matrix attributes take one location per row.
+	std::vector<GLuint> const & vertex_attribute_locations() const { return vertex_attribute_locations_; }
+
 	shader_program const & program() const { return program_; }
 
 	/// Compile and link the program from the (generated) sources.
+	/// \param cache If given, the linked program is loaded from or stored in this cache.
 	/// \note This does not generate the sources, use compiler::compile[_source] for that.
-	void compile_program();
+	void compile_program(program_binary_cache const * cache = nullptr);
+
+	/// Like compile_program(), but only starts compiling and linking.
+	/// Use program_ready() to check if finish_compile_program() would have to wait.
+	void start_compile_program(program_binary_cache const * cache = nullptr);
+
+	bool program_ready() const;
+
+	/// Waits for the compiling and linking started by start_compile_program() to finish.
+	/// \throws gl_error if it failed.
+	void finish_compile_program();
+
+	/// Starts compiling and linking the program as part of a batch.
+	shader_batch::handle compile_program(shader_batch &, program_binary_cache const * cache = nullptr);
 
 	void use() const;
 
@@ -0,0 +1,146 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../core/fence.hpp"
+#include "../core/texture.hpp"
+#include "../core/vbo.hpp"
+#include "buffer.hpp"
+
+namespace moggle {
+
+/// A thread that uploads data to the GPU in the background, with its own context that shares objects with the render thread.
+/// \note Finished uploads are only applied by poll() (or wait() or finish()) on the render thread.
+class upload_thread {
+
+private:
+	struct job {
+		std::function<void()> work; // On the upload thread.
+		std::function<void()> apply; // On the render thread, after the fence has signaled.
+		fence done_fence;
+		std::exception_ptr error;
+		std::atomic<bool> submitted{false};
+		bool applied = false;
+	};
+
+public:
+	/// Refers to a queued upload.
+	class ticket {
+	private:
+		std::shared_ptr<job const> job_;
+		friend class upload_thread;
+		ticket(std::shared_ptr<job const> j) : job_(std::move(j)) {}
+	public:
+		ticket() {}
+		bool valid() const { return bool(job_); }
+		explicit operator bool() const { return valid(); }
+		/// Whether the upload is finished and applied by upload_thread::poll().
+		bool done() const { return job_->applied; }
+	};
+
+private:
+	std::function<void()> release_context_;
+
+	// Shared with the upload thread.
+	std::mutex mutex_;
+	std::condition_variable queued_;
+	std::condition_variable submitted_;
+	std::deque<std::shared_ptr<job>> queue_;
+	bool stop_ = false;
+
+	// Only used by the render thread.
+	std::deque<std::shared_ptr<job>> in_flight_;
+
+	std::thread thread_;
+
+	void thread_main(std::function<void()> const & make_context_current);
+
+public:
+	/// Starts the thread.
+	/// \param make_context_current Called on the new thread to make the shared context current.
+	/// \param release_context Called on the thread before it stops, e.g. to release the context.
+	explicit upload_thread(
+		std::function<void()> make_context_current,
+		std::function<void()> release_context = nullptr
+	);
+
+	/// Waits for the queued uploads to be done, and stops the thread.
+	/// Uploads that are not yet applied are dropped.
+	~upload_thread();
+
+	upload_thread(upload_thread const &) = delete;
+	upload_thread & operator = (upload_thread const &) = delete;
+
+	/// Queues work to be done on the upload thread, with the shared context current.
+	/// \param apply Called by poll() on the render thread once the GPU has finished the work.
+	ticket run(std::function<void()> work, std::function<void()> apply = nullptr);
+
+	/// Uploads the current data of a buffer into a new vbo, which replaces the old one when done.
+	/// Until then, the old vbo keeps being used.
+	ticket upload(generic_buffer &);
+
+	/// Uploads the current data of multiple buffers, which are replaced together when done.
+	ticket upload(std::vector<generic_buffer *> const &);
+
+	/// Uploads data into a new vbo, which replaces v when done.
+	template<typename T>
+	ticket upload(vbo<T> & v, std::vector<T> data, GLenum usage = GL_STATIC_DRAW) {
+		auto new_vbo = std::make_shared<vbo<T>>();
+		auto shared_data = std::make_shared<std::vector<T>>(std::move(data));
+		return run(
+			[=] { new_vbo->data(*shared_data, usage); shared_data->clear(); },
+			[=, &v] { v = std::move(*new_vbo); }
+		);
+	}
+
+	/// Uploads tightly packed pixels to a texture, which must already have storage.
+	ticket upload(
+		texture & t,
+		GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+		GLenum format, GLenum type,
+		std::vector<unsigned char> pixels
+	);
+
+	/// Applies the uploads that are finished on the GPU, in the order they were queued.
+	/// Call this regularly (e.g. once per frame) on the render thread.
+	/// \return The number of applied uploads.
+	/// \throws The exception thrown by the upload, if any.
+	std::size_t poll();
+
+	/// Waits until the given upload is done, and applies it and everything queued before it.
+	void wait(ticket const &);
+
+	/// Waits until all queued uploads are done, and applies them.
+	void finish();
+
+	/// The number of uploads that are not yet applied.
+	std::size_t pending() const { return in_flight_.size(); }
+
+};
+
+}
@@ -45,6 +45,7 @@ public:
 		GLenum type; // One of GL_FLOAT, GL_INT, etc.
 		bool normalized;
 		std::size_t size_of_type;
+		GLuint divisor; // 0 for per-vertex attributes, n to advance once every n instances.
 	};
 
 private:
@@ -76,18 +77,44 @@ public:
 		bool exists() const { return a; }
 		explicit operator bool () const { return exists(); }
 		std::string const & name() const { return n; }
+		/// Uses this attribute for the given attribute index.
+		/// Matrices take one index per row, starting at attribute_id. See vao::matrix_attribute().
 		void use(GLuint attribute_id) const {
 			must_exist();
 			a->buffer->sync(); // TODO: check if this line belongs here or somewhere else.
-			v.vao_.attribute(
-				attribute_id,
-				*(a->buffer),
-				a->width * a->height,
-				a->type,
-				a->normalized,
-				a->size_of_type,
-				nullptr
-			);
+			if (a->width == 1) {
+				v.vao_.attribute(
+					attribute_id,
+					*(a->buffer),
+					a->height,
+					a->type,
+					a->normalized,
+					a->size_of_type,
+					nullptr,
+					a->divisor
+				);
+			} else {
+				v.vao_.matrix_attribute(
+					attribute_id,
+					*(a->buffer),
+					a->height,
+					a->width,
+					a->type,
+					a->normalized,
+					a->size_of_type,
+					nullptr,
+					a->divisor
+				);
+			}
+		}
+		/// The number of attribute indices this attribute takes.
+		std::size_t slots() const {
+			must_exist();
+			return a->width == 1 ? 1 : a->height;
+		}
+		GLuint divisor() const {
+			must_exist();
+			return a->divisor;
 		}
 		std::shared_ptr<typename std::conditional<Const, class generic_buffer const, class generic_buffer>::type>
 		generic_buffer() {
@@ -107,8 +134,9 @@ public:
 public:
 	std::map<std::string, attribute_data> const & attributes() const { return attributes_; }
 
+	/// \param divisor 0 for per-vertex data, or n for per-instance data that advances once every n instances.
 	template<typename T>
-	void attribute(std::string const & name, std::shared_ptr<buffer<T>> buf) {
+	void attribute(std::string const & name, std::shared_ptr<buffer<T>> buf, GLuint divisor = 0) {
 		using mt = matrix_traits<T>;
 		using nt = normalized_type_traits<typename mt::element_type>;
 		attributes_[name] = {
@@ -117,13 +145,14 @@ public:
 			mt::height,
 			gl_type_traits<typename nt::raw_type>::gl_constant,
 			nt::is_normalized_type,
-			sizeof(T)
+			sizeof(T),
+			divisor
 		};
 	}
 
 	template<typename T>
-	void attribute(std::string const & name, buffer<T> && buf) {
-		attribute(name, buf.make_shared());
+	void attribute(std::string const & name, buffer<T> && buf, GLuint divisor = 0) {
+		attribute(name, buf.make_shared(), divisor);
 	}
 
 	attribute_ref<true> attribute(std::string const & name) const {
@@ -144,6 +173,21 @@ public:
 		return { *this, &i->second, i->first };
 	}
 
+	/// The number of vertices: the number of elements in the (synced) buffers of the per-vertex attributes.
+	/// If they differ, the smallest number is used.
+	std::size_t size() const {
+		std::size_t n = 0;
+		bool first = true;
+		for (auto const & a : attributes_) {
+			if (a.second.divisor) continue;
+			a.second.buffer->sync();
+			std::size_t s = a.second.buffer->vbo().size_in_bytes() / a.second.size_of_type;
+			if (first || s < n) n = s;
+			first = false;
+		}
+		return n;
+	}
+
 	void bind() const {
 		vao_.bind();
 	}
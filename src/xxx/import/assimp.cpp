@@ -15,6 +15,7 @@
 // You should have received a copy of the GNU General Public License
 // along with Moggle. If not, see <http://www.gnu.org/licenses/>.
 
+#include <numeric>
 #include <vector>
 #include <sstream>
 #include <string>
@@ -29,67 +30,152 @@
 #include <moggle/xxx/buffer.hpp>
 #include <moggle/xxx/vertices.hpp>
 #include <moggle/xxx/mesh.hpp>
+#include <moggle/xxx/import/assimp.hpp>
 
 namespace moggle {
 
-mesh import_mesh(char const * file_name) {
-	Assimp::Importer importer;
-
-	aiScene const * ai_scene = importer.ReadFile(
-		file_name,
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_GenNormals |
-		aiProcess_SortByPType
-	);
+namespace {
+
+	aiScene const * read(Assimp::Importer & importer, char const * file_name) {
+		aiScene const * ai_scene = importer.ReadFile(
+			file_name,
+			aiProcess_Triangulate |
+			aiProcess_JoinIdenticalVertices |
+			aiProcess_GenNormals |
+			aiProcess_SortByPType
+		);
+		if (!ai_scene) throw std::runtime_error(std::string("Unable to import mesh: ") + importer.GetErrorString());
+		return ai_scene;
+	}
 
-	if (!ai_scene) throw std::runtime_error(std::string("Unable to import mesh: ") + importer.GetErrorString());
+	// A part of an aiMesh: the vertices it uses, and its triangles as indices into those.
+	struct chunk {
+		std::vector<unsigned int> vertices; // Indices of the vertices of the aiMesh.
+		std::vector<GLuint> indices; // Indices into chunk::vertices.
+	};
+
+	// Splits the triangles of a mesh into chunks that use at most max_vertices vertices each.
+	std::vector<chunk> split(aiMesh const & am, std::size_t max_vertices) {
+		std::vector<chunk> chunks;
+		if (am.mNumVertices <= max_vertices) {
+			chunks.emplace_back();
+			chunk & c = chunks.back();
+			c.vertices.resize(am.mNumVertices);
+			std::iota(c.vertices.begin(), c.vertices.end(), 0u);
+			c.indices.resize(am.mNumFaces * 3);
+			for (size_t i = 0; i < am.mNumFaces; ++i) {
+				c.indices[i*3  ] = am.mFaces[i].mIndices[0];
+				c.indices[i*3+1] = am.mFaces[i].mIndices[1];
+				c.indices[i*3+2] = am.mFaces[i].mIndices[2];
+			}
+			return chunks;
+		}
+		GLuint const none = GLuint(-1);
+		std::vector<GLuint> local(am.mNumVertices, none); // The index in the last chunk of every vertex.
+		for (size_t i = 0; i < am.mNumFaces; ++i) {
+			unsigned int const * face = am.mFaces[i].mIndices;
+			std::size_t new_vertices = 0;
+			for (size_t j = 0; j < 3; ++j) if (local[face[j]] == none) ++new_vertices;
+			if (chunks.empty() || chunks.back().vertices.size() + new_vertices > max_vertices) {
+				if (!chunks.empty()) for (auto v : chunks.back().vertices) local[v] = none;
+				chunks.emplace_back();
+			}
+			chunk & c = chunks.back();
+			for (size_t j = 0; j < 3; ++j) {
+				GLuint & l = local[face[j]];
+				if (l == none) {
+					l = c.vertices.size();
+					c.vertices.push_back(face[j]);
+				}
+				c.indices.push_back(l);
+			}
+		}
+		return chunks;
+	}
 
-	aiMesh const & am = *ai_scene->mMeshes[0]; // TODO: What about multiple meshes?
+	// The vertices of the mesh with the given indices.
+	vertices make_vertices(aiMesh const & am, std::vector<unsigned int> const & ids) {
+		vertices vertices;
+
+		{
+			buffer<hvector4<float>> positions(ids.size());
+			buffer<vector3<float>> normals(ids.size());
+			for(size_t i = 0; i < ids.size(); ++i) {
+				positions[i] = { am.mVertices[ids[i]][0], am.mVertices[ids[i]][1], am.mVertices[ids[i]][2] };
+				normals  [i] = { am. mNormals[ids[i]][0], am. mNormals[ids[i]][1], am. mNormals[ids[i]][2] };
+			}
+			vertices.attribute("position", std::move(positions));
+			vertices.attribute("normal"  , std::move(normals  ));
+		}
 
-	vertices vertices;
+		for (size_t n = 0; n < am.GetNumColorChannels(); ++n) {
+			buffer<hvector4<float>> colors(ids.size());
+			for(size_t i = 0; i < ids.size(); ++i) {
+				auto const & c = am.mColors[n][ids[i]];
+				colors[i] = {c.r, c.g, c.b, c.a};
+			}
+			std::ostringstream name("color", std::ios_base::ate);
+			if (n) name << (n + 1);
+			vertices.attribute(name.str(), std::move(colors));
+		}
 
-	{
-		buffer<hvector4<float>> positions(am.mNumVertices);
-		buffer<vector3<float>> normals(am.mNumVertices);
-		for(unsigned int i = 0; i < am.mNumVertices; ++i) {
-			positions[i] = { am.mVertices[i][0], am.mVertices[i][1], am.mVertices[i][2] };
-			normals  [i] = { am. mNormals[i][0], am. mNormals[i][1], am. mNormals[i][2] };
+		for (size_t n = 0; n < am.GetNumUVChannels(); ++n) {
+			buffer<vector3<float>> uvs(ids.size());
+			for(size_t i = 0; i < ids.size(); ++i) {
+				auto const & t = am.mTextureCoords[n][ids[i]];
+				uvs[i] = { t[0], t[1], t[1] };
+			}
+			std::ostringstream name("texture_coordinate", std::ios_base::ate);
+			if (n) name << (n + 1);
+			vertices.attribute(name.str(), std::move(uvs));
 		}
-		vertices.attribute("position", std::move(positions));
-		vertices.attribute("normal"  , std::move(normals  ));
+
+		return vertices;
 	}
 
-	for (size_t n = 0; n < am.GetNumColorChannels(); ++n) {
-		buffer<hvector4<float>> colors(am.mNumVertices);
-		for(unsigned int i = 0; i < am.mNumVertices; ++i) {
-			auto const & c = am.mColors[n][i];
-			colors[i] = {c.r, c.g, c.b, c.a};
-		}
-		std::ostringstream name("color", std::ios_base::ate);
-		if (n) name << (n + 1);
-		vertices.attribute(name.str(), std::move(colors));
+	template<typename Index>
+	mesh make_mesh(vertices && v, std::vector<GLuint> const & indices) {
+		return mesh(std::move(v), buffer<Index>(indices.begin(), indices.end()));
 	}
 
-	for (size_t n = 0; n < am.GetNumUVChannels(); ++n) {
-		buffer<vector3<float>> uvs(am.mNumVertices);
-		for(unsigned int i = 0; i < am.mNumVertices; ++i) {
-			uvs[i] = { am.mTextureCoords[n][i][0], am.mTextureCoords[n][i][1], am.mTextureCoords[n][i][1] };
+	mesh make_mesh(aiMesh const & am, chunk const & c, GLenum smallest_index_type) {
+		vertices v = make_vertices(am, c.vertices);
+		switch (index_type_for(c.vertices.size(), smallest_index_type)) {
+			case GL_UNSIGNED_BYTE: return make_mesh<GLubyte>(std::move(v), c.indices);
+			case GL_UNSIGNED_SHORT: return make_mesh<GLushort>(std::move(v), c.indices);
+			default: return make_mesh<GLuint>(std::move(v), c.indices);
 		}
-		std::ostringstream name("texture_coordinate", std::ios_base::ate);
-		if (n) name << (n + 1);
-		vertices.attribute(name.str(), std::move(uvs));
 	}
 
-	buffer<GLushort> indices(am.mNumFaces * 3);
+}
+
+mesh import_mesh(char const * file_name, GLenum smallest_index_type) {
+	Assimp::Importer importer;
+
+	aiScene const * ai_scene = read(importer, file_name);
+
+	aiMesh const & am = *ai_scene->mMeshes[0]; // See import_meshes() for the other meshes.
+
+	return make_mesh(am, split(am, am.mNumVertices).front(), smallest_index_type);
+}
 
-	for (size_t i = 0; i < am.mNumFaces; ++i) {
-		indices[i*3  ] = am.mFaces[i].mIndices[0];
-		indices[i*3+1] = am.mFaces[i].mIndices[1];
-		indices[i*3+2] = am.mFaces[i].mIndices[2];
+std::vector<mesh> import_meshes(char const * file_name, import_options const & options) {
+	Assimp::Importer importer;
+
+	aiScene const * ai_scene = read(importer, file_name);
+
+	std::vector<mesh> meshes;
+
+	for (unsigned int m = 0; m < ai_scene->mNumMeshes; ++m) {
+		aiMesh const & am = *ai_scene->mMeshes[m];
+		if (!(am.mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) continue;
+		std::size_t max_vertices = options.split_large_meshes ? 0x10000 : am.mNumVertices;
+		for (auto const & c : split(am, max_vertices)) {
+			meshes.push_back(make_mesh(am, c, options.smallest_index_type));
+		}
 	}
 
-	return mesh(std::move(vertices), std::move(indices));
+	return meshes;
 }
 
 }
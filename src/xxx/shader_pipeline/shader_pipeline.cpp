@@ -146,6 +146,34 @@ namespace {
 			return *this;
 		}
 	};
+
+	// The number of rows of a matrix type (e.g. 4 for mat2x4), or 0 for other types.
+	// Matrix attributes are uploaded row by row, so this is the number of locations it takes.
+	unsigned int matrix_rows(std::string const & type) {
+		std::size_t i = type.compare(0, 3, "mat") == 0 ? 3 : type.compare(0, 4, "dmat") == 0 ? 4 : 0;
+		if (!i || i >= type.size()) return 0;
+		auto x = type.find('x', i);
+		if (x != std::string::npos) i = x + 1;
+		if (i >= type.size() || type[i] < '2' || type[i] > '4') return 0;
+		return type[i] - '0';
+	}
+
+	// mat2x4 -> mat4x2
+	std::string transposed_type(std::string const & type) {
+		auto x = type.find('x');
+		if (x == std::string::npos) return type;
+		return type.substr(0, x - 1) + type.substr(x + 1) + 'x' + type[x - 1];
+	}
+
+	// Matrix attributes are declared transposed under this name, see vao::matrix_attribute().
+	std::string attribute_name(variable const & v) {
+		return matrix_rows(v.type) ? "_t_" + v.name : v.name;
+	}
+
+	// The output of the vertex shader that captures a variable, see pipeline::captured_outputs.
+	std::string captured_name(variable const & v) {
+		return "_c_" + v.name;
+	}
 }
 
 void compiler::compile_source(pipeline & p) {
@@ -214,9 +242,12 @@ void compiler::compile_source(pipeline & p) {
 		}
 	};
 
+	std::set<variable> matrix_attributes;
+
 	auto var_name = [&](std::string const & v) -> std::string {
 		if (local_variables.count(v)) return "_l_" + v;
 		if (varying_variables.count(v)) return "_v_" + v;
+		if (matrix_attributes.count(v)) return "transpose(_t_" + v + ")";
 		return v;
 	};
 
@@ -306,25 +337,44 @@ void compiler::compile_source(pipeline & p) {
 		if (v.second.empty()) continue;
 		required_variables.insert(variable(v.first.type, v.second));
 	}
+	for (auto const & v : p.captured_outputs) {
+		required_variables.insert(v);
+	}
 
 	local_variables.clear();
 
 	process_operations(p.vertex_operations);
-	auto vertex_operations_statements = generate_statements(p.vertex_operations);
 
 	p.vertex_attributes_.clear();
+	p.vertex_attribute_locations_.clear();
+	GLuint location = 0;
 	for (auto const & v : required_variables) {
 		if (p.uniform_variables.count(v)) continue;
 		p.vertex_attributes_.push_back(v);
-		vertex_shader << "attribute " << v << ";" << '\n';
+		p.vertex_attribute_locations_.push_back(location);
+		if (unsigned int rows = matrix_rows(v.type)) {
+			if (glsl_version() < 120) throw compile_error{"Matrix attribute '" + v.name + "' requires at least #version 120."};
+			matrix_attributes.insert(v);
+			vertex_shader << "attribute " << transposed_type(v.type) << " " << attribute_name(v) << ";" << '\n';
+			location += rows;
+		} else {
+			vertex_shader << "attribute " << v << ";" << '\n';
+			location += 1;
+		}
+	}
+
+	for (auto const & v : p.captured_outputs) {
+		vertex_shader << "varying " << v.type << " " << captured_name(v) << ";" << '\n';
 	}
 
+	auto vertex_operations_statements = generate_statements(p.vertex_operations);
+
 	vertex_shader << "void main() {" << '\n';
 
 	for (auto const & v : local_variables) {
 		vertex_shader << '\t' << v.type << " _l_" << v.name;
 		if (required_variables.count(v)) {
-			vertex_shader << " = " << v.name;
+			vertex_shader << " = " << (matrix_attributes.count(v) ? "transpose(_t_" + v.name + ")" : v.name);
 		}
 		vertex_shader << ";" << '\n';
 	}
@@ -338,6 +388,9 @@ void compiler::compile_source(pipeline & p) {
 	for (auto const & v : varying_outputs) {
 		vertex_shader << '\t' << "_v_" << v.name << " = " << var_name(v.name) << ";" << '\n';
 	}
+	for (auto const & v : p.captured_outputs) {
+		vertex_shader << '\t' << captured_name(v) << " = " << var_name(v.name) << ";" << '\n';
+	}
 
 	vertex_shader << "}" << '\n';
 
@@ -345,19 +398,69 @@ void compiler::compile_source(pipeline & p) {
 	p.fragment_shader_source_ = fragment_shader.str();
 }
 
-void compiler::compile(pipeline & p) {
+void compiler::compile(pipeline & p, program_binary_cache const * cache) {
 	compile_source(p);
-	p.compile_program();
+	p.compile_program(cache);
 }
 
-void pipeline::compile_program() {
+void pipeline::compile_program(program_binary_cache const * cache) {
+	start_compile_program(cache);
+	finish_compile_program();
+}
+
+void pipeline::start_compile_program(program_binary_cache const * cache) {
+	pending_shaders_.clear();
+	pending_cache_ = nullptr;
 	program_.clear();
-	program_.attach(moggle::shader::from_source(shader_type::  vertex,   vertex_shader_source_));
-	program_.attach(moggle::shader::from_source(shader_type::fragment, fragment_shader_source_));
+	if (cache) {
+		std::vector<std::string> key_parts { vertex_shader_source_, fragment_shader_source_ };
+		for (auto const & a : vertex_attributes_) key_parts.push_back(a.name);
+		for (auto const & c : captured_outputs) key_parts.push_back(captured_name(c));
+		pending_key_ = cache->key(key_parts);
+		if (cache->load(program_, pending_key_)) return;
+		program_.clear();
+		pending_cache_ = cache;
+		if (gl::features().program_binary) program_.binary_retrievable();
+	}
+	auto add_shader = [&] (shader_type type, std::string const & source) {
+		pending_shaders_.emplace_back(type);
+		pending_shaders_.back().load(source);
+		pending_shaders_.back().try_compile();
+		program_.attach(pending_shaders_.back());
+	};
+	add_shader(shader_type::  vertex,   vertex_shader_source_);
+	add_shader(shader_type::fragment, fragment_shader_source_);
 	for (size_t i = 0; i < vertex_attributes_.size(); ++i) {
-		program_.bind_attribute(i, vertex_attributes_[i].name);
+		program_.bind_attribute(vertex_attribute_locations_[i], attribute_name(vertex_attributes_[i]));
 	}
-	program_.link();
+	if (!captured_outputs.empty()) {
+		std::vector<std::string> names;
+		for (auto const & c : captured_outputs) names.push_back(captured_name(c));
+		program_.capture(names);
+	}
+	program_.try_link();
+}
+
+bool pipeline::program_ready() const {
+	return pending_shaders_.empty() || program_.ready();
+}
+
+void pipeline::finish_compile_program() {
+	if (pending_shaders_.empty()) return; // Loaded from the cache, or already finished.
+	auto shaders = std::move(pending_shaders_);
+	pending_shaders_.clear();
+	for (auto const & s : shaders) s.finish_compile();
+	program_.finish_link();
+	if (pending_cache_) pending_cache_->store(program_, pending_key_);
+	pending_cache_ = nullptr;
+}
+
+shader_batch::handle pipeline::compile_program(shader_batch & batch, program_binary_cache const * cache) {
+	start_compile_program(cache);
+	return batch.add(
+		[this] { return program_ready(); },
+		[this] { finish_compile_program(); }
+	);
 }
 
 void pipeline::use() const {
@@ -0,0 +1,141 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+#include <moggle/core/gl.hpp>
+#include <moggle/xxx/upload_thread.hpp>
+
+namespace moggle {
+
+upload_thread::upload_thread(
+	std::function<void()> make_context_current,
+	std::function<void()> release_context
+) : release_context_(std::move(release_context)) {
+	thread_ = std::thread(&upload_thread::thread_main, this, std::move(make_context_current));
+}
+
+upload_thread::~upload_thread() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	queued_.notify_one();
+	thread_.join();
+}
+
+void upload_thread::thread_main(std::function<void()> const & make_context_current) {
+	make_context_current();
+	while (true) {
+		std::shared_ptr<job> j;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			queued_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+			if (queue_.empty()) break;
+			j = std::move(queue_.front());
+			queue_.pop_front();
+		}
+		try {
+			j->work();
+			j->done_fence.insert();
+			gl::flush(); // Make sure the fence can signal without this context doing anything else.
+		} catch (...) {
+			j->error = std::current_exception();
+		}
+		// Whatever the work captured is released here, but apply() is released on the render thread.
+		j->work = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			j->submitted = true;
+		}
+		submitted_.notify_all();
+	}
+	if (release_context_) release_context_();
+}
+
+upload_thread::ticket upload_thread::run(std::function<void()> work, std::function<void()> apply) {
+	auto j = std::make_shared<job>();
+	j->work = std::move(work);
+	j->apply = std::move(apply);
+	in_flight_.push_back(j);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(j);
+	}
+	queued_.notify_one();
+	return ticket{j};
+}
+
+upload_thread::ticket upload_thread::upload(generic_buffer & b) {
+	return upload(std::vector<generic_buffer *>{&b});
+}
+
+upload_thread::ticket upload_thread::upload(std::vector<generic_buffer *> const & buffers) {
+	auto uploads = std::make_shared<std::vector<std::unique_ptr<generic_buffer::pending_upload>>>();
+	for (auto b : buffers) uploads->push_back(b->start_upload());
+	return run(
+		[uploads] { for (auto & u : *uploads) u->upload(); },
+		[uploads] { for (auto & u : *uploads) u->apply(); }
+	);
+}
+
+upload_thread::ticket upload_thread::upload(
+	texture & t,
+	GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+	GLenum format, GLenum type,
+	std::vector<unsigned char> pixels
+) {
+	auto shared_pixels = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+	return run([=, &t] {
+		gl::pixel_store_i(GL_UNPACK_ALIGNMENT, 1);
+		t.image(level, x, y, width, height, format, type, shared_pixels->data());
+	});
+}
+
+std::size_t upload_thread::poll() {
+	std::size_t n = 0;
+	while (!in_flight_.empty()) {
+		auto j = in_flight_.front();
+		if (!j->submitted) break;
+		if (!j->error && !j->done_fence.signaled()) break;
+		in_flight_.pop_front();
+		j->done_fence.clear();
+		j->applied = true;
+		auto apply = std::move(j->apply);
+		j->apply = nullptr;
+		if (j->error) std::rethrow_exception(j->error);
+		if (apply) apply();
+		++n;
+	}
+	return n;
+}
+
+void upload_thread::wait(ticket const & t) {
+	while (t && !t.done()) {
+		auto j = in_flight_.front();
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			submitted_.wait(lock, [&] { return bool(j->submitted); });
+		}
+		if (!j->error) j->done_fence.wait();
+		poll();
+	}
+}
+
+void upload_thread::finish() {
+	while (!in_flight_.empty()) wait(ticket{in_flight_.back()});
+}
+
+}
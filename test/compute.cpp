@@ -0,0 +1,117 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+// Tests compute shaders (see shader_program::dispatch()) with a surfaceless EGL context.
+// Runs without a GPU or display on Mesa (e.g. with LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe).
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <moggle/core/gl.hpp>
+#include <moggle/core/shader.hpp>
+#include <moggle/core/vbo.hpp>
+
+using namespace moggle;
+
+namespace {
+
+// Creates a surfaceless OpenGL 4.3 core profile context, and makes it current.
+void create_context() {
+	auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (!get_platform_display) throw std::runtime_error("EGL_EXT_platform_base is not supported.");
+	EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (!eglInitialize(display, nullptr, nullptr)) throw std::runtime_error("Unable to initialize EGL.");
+	eglBindAPI(EGL_OPENGL_API);
+	EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT) throw std::runtime_error("Unable to create an OpenGL 4.3 context.");
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) throw std::runtime_error("Unable to make the context current.");
+}
+
+void check(bool condition, char const * what) {
+	if (!condition) throw std::runtime_error(std::string("Check failed: ") + what);
+}
+
+// Doubles every element of the storage buffer, and adds its index.
+char const * source = R"(
+	#version 430
+	layout(local_size_x = 4, local_size_y = 1, local_size_z = 1) in;
+	layout(std430) buffer Data { uint values[]; };
+	void main() {
+		uint i = gl_GlobalInvocationID.x;
+		values[i] = values[i] * 2u + i;
+	}
+)";
+
+std::vector<GLuint> read(vbo<GLuint> const & data) {
+	gl::memory_barrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	std::vector<GLuint> result(data.size());
+	data.read(0, result.size() * sizeof(GLuint), result.data());
+	return result;
+}
+
+}
+
+int main() {
+	try {
+		create_context();
+		#ifdef GLEW_VERSION
+		glewExperimental = GL_TRUE;
+		#endif
+		gl::init();
+		check(gl::features().compute_shader, "compute shaders are supported");
+
+		shader_program program;
+		program.attach(shader::from_source(shader_type::compute, source));
+		program.link();
+		vector3<GLint> size = program.work_group_size();
+		check(size[0] == 4 && size[1] == 1 && size[2] == 1, "work_group_size() is the declared local size");
+		check(program.storage_block("Data", 2), "the program has the storage block");
+
+		vbo<GLuint> data(std::vector<GLuint>{1, 2, 3, 4, 5, 6, 7, 8});
+		data.bind_base(GL_SHADER_STORAGE_BUFFER, 2);
+
+		// Two work groups of four cover the whole buffer.
+		program.dispatch(2);
+		std::vector<GLuint> values = read(data);
+		for (GLuint i = 0; i < 8; ++i) check(values[i] == (i + 1) * 2 + i, "dispatch() writes every element");
+
+		// One work group, as read from the indirect buffer, only covers the first half.
+		vbo<dispatch_indirect_command> commands(std::vector<dispatch_indirect_command>{{1, 1, 1}});
+		program.dispatch_indirect(commands);
+		values = read(data);
+		for (GLuint i = 0; i < 8; ++i) {
+			GLuint expected = (i + 1) * 2 + i;
+			if (i < 4) expected = expected * 2 + i;
+			check(values[i] == expected, "dispatch_indirect() uses the number of work groups from the buffer");
+		}
+	} catch (std::exception const & e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,200 @@
+// Copyright 2013 Mara Bos
+//
+// This file is part of Moggle.
+//
+// Moggle is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Moggle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Moggle. If not, see <http://www.gnu.org/licenses/>.
+
+// Tests upload_thread with two surfaceless EGL contexts that share their objects.
+// Runs without a GPU or display on Mesa (e.g. with LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe).
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <moggle/core/framebuffer.hpp>
+#include <moggle/core/gl.hpp>
+#include <moggle/xxx/mesh.hpp>
+#include <moggle/xxx/shader_pipeline.hpp>
+#include <moggle/xxx/upload_thread.hpp>
+
+using namespace moggle;
+
+namespace {
+
+EGLDisplay display = EGL_NO_DISPLAY;
+
+// Creates a surfaceless core profile context, sharing its objects with the given context.
+EGLContext create_context(EGLContext share = EGL_NO_CONTEXT) {
+	if (display == EGL_NO_DISPLAY) {
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (!get_platform_display) throw std::runtime_error("EGL_EXT_platform_base is not supported.");
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (!eglInitialize(display, nullptr, nullptr)) throw std::runtime_error("Unable to initialize EGL.");
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, share, attributes);
+	if (context == EGL_NO_CONTEXT) throw std::runtime_error("Unable to create an OpenGL context.");
+	return context;
+}
+
+void make_current(EGLContext context) {
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) throw std::runtime_error("Unable to make the context current.");
+}
+
+void check(bool condition, char const * what) {
+	if (!condition) throw std::runtime_error(std::string("Check failed: ") + what);
+}
+
+// Draws the mesh over the whole 4x1 target, and returns the red value of the first pixel.
+float draw(mesh const & m) {
+	gl::clear_color(0, 0, 0, 0);
+	gl::clear(GL_COLOR_BUFFER_BIT);
+	m.draw();
+	float pixel[4];
+	gl::read_pixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, pixel);
+	return pixel[0];
+}
+
+mesh make_mesh(float value, bool indexed) {
+	vertices v;
+	if (indexed) {
+		v.attribute("position", buffer<vector2<float>>{{-1, -1}, {1, -1}, {1, 1}, {-1, 1}});
+		v.attribute("value", buffer<float>(4, value));
+		return mesh{std::move(v), buffer<GLushort>{0, 1, 2, 0, 2, 3}};
+	}
+	v.attribute("position", buffer<vector2<float>>{{-1, -1}, {1, -1}, {1, 1}, {-1, -1}, {1, 1}, {-1, 1}});
+	v.attribute("value", buffer<float>(6, value));
+	return mesh{std::move(v)};
+}
+
+void test_mesh(upload_thread & u, bool indexed) {
+	mesh m = make_mesh(0.25f, indexed);
+
+	// The first upload: nothing is drawn until it is done.
+	m.upload(u);
+	u.finish();
+	check(draw(m) == 0.25f, "the first upload is drawn");
+
+	// A new upload: the old data is drawn until it is done.
+	auto values = m.vertices()->attribute("value").buffer<float>();
+	for (auto & x : *values) x = 0.5f;
+	m.upload(u);
+	check(!values->is_dirty(), "an upload marks the buffer as synchronized");
+	float before = draw(m);
+	check(before == 0.25f || before == 0.5f, "the old data is drawn during an upload");
+	u.finish();
+	check(draw(m) == 0.5f, "the new upload is drawn");
+}
+
+void test_buffers(upload_thread & u) {
+	// A buffer that is moved before the upload is applied gets the new vbo.
+	buffer<int> a{1, 2, 3};
+	auto t = u.upload(a);
+	buffer<int> b = std::move(a);
+	u.wait(t);
+	check(b.vbo().size() == 3, "a moved buffer gets its upload");
+	int data[3];
+	b.vbo().read(0, sizeof data, data);
+	check(data[2] == 3, "the uploaded data is correct");
+
+	// A buffer that is destroyed before the upload is applied is left alone.
+	std::unique_ptr<buffer<int>> c{new buffer<int>{4, 5, 6}};
+	u.upload(*c);
+	c.reset();
+	u.finish();
+
+	// Plain vbos and textures.
+	vbo<int> raw;
+	u.upload(raw, std::vector<int>{7, 8, 9});
+	texture tex;
+	tex.storage(GL_RGBA8, 2, 2, 1);
+	u.upload(tex, 0, 0, 0, 2, 2, GL_RGBA, GL_UNSIGNED_BYTE, std::vector<unsigned char>(16, 99));
+
+	// Exceptions on the upload thread are thrown by poll().
+	u.run([] { throw std::logic_error("upload failed"); });
+	bool threw = false;
+	try {
+		u.finish();
+	} catch (std::logic_error const &) {
+		threw = true;
+	}
+	check(threw, "an exception of an upload is thrown on the render thread");
+	u.finish();
+
+	check(raw.size() == 3, "a vbo gets its upload");
+	framebuffer f;
+	f.attach(GL_COLOR_ATTACHMENT0, tex);
+	f.bind(GL_READ_FRAMEBUFFER);
+	unsigned char pixel[4];
+	gl::read_pixels(1, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	check(pixel[2] == 99, "a texture gets its upload");
+}
+
+}
+
+int main() {
+	try {
+		EGLContext render_context = create_context();
+		make_current(render_context);
+		#ifdef GLEW_VERSION
+		glewExperimental = GL_TRUE;
+		#endif
+		gl::init();
+		EGLContext upload_context = create_context(render_context);
+
+		texture color;
+		color.storage(GL_RGBA32F, 4, 1, 1);
+		framebuffer target;
+		target.attach(GL_COLOR_ATTACHMENT0, color);
+		target.check();
+		target.bind();
+		gl::viewport(0, 0, 4, 1);
+
+		pipeline_compiler compiler(330);
+		compiler.add_code(R"(
+			operation place(in vec2 position, in float value, out vec4 p, out float v) { p = vec4(position, 0, 1); v = value; }
+			operation shade(in float v, out vec4 c) { c = vec4(v); }
+		)");
+		pipeline p;
+		p.vertex_operations.push_back("place");
+		p.special_vertex_outputs[{"vec4", "gl_Position"}] = "p";
+		p.fragment_operations.push_back("shade");
+		p.special_fragment_outputs[{"vec4", "gl_FragColor"}] = "c";
+		compiler.compile(p);
+		p.use();
+
+		upload_thread u{
+			[&] { make_current(upload_context); },
+			[&] { make_current(EGL_NO_CONTEXT); }
+		};
+		test_mesh(u, true);
+		test_mesh(u, false);
+		test_buffers(u);
+	} catch (std::exception const & e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+}